@@ -0,0 +1,960 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "num.h" /* Dependency for big.h, stack.h */
+#include "big.h"
+#include "stack.h" /* Dependency for op.h, prog.h */
+#include "op.h" /* Dependency for prog.h */
+#include "prog.h"
+
+#define BIG_KARATSUBA 32 /* Limbs below which products are schoolbook */
+#define BIG_LEAF 16 /* Factors multiplied one by one in a product tree */
+#define BIG_CONV_LEAF 8 /* Limbs below which conversion divides by chunks */
+#define BIG_DIGITS 19 /* Decimal digits per chunk */
+#define BIG_CHUNK 10000000000000000000ULL /* 10^BIG_DIGITS */
+#define BIG_POW_MAX 32
+#define BIG_SIEVE_MAX 4194304 /* Largest n for which nCr factors over primes */
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 BigW;
+#endif
+
+/* Magnitude and sign of an integer or big integer argument */
+typedef struct {
+	const uint64_t *a;
+	int n;
+	int neg;
+	uint64_t buf;
+} BigRef;
+
+/* Factors of a product, packed so that each one fills a limb */
+typedef struct {
+	uint64_t *f;
+	int n, size;
+	uint64_t acc;
+} BigFac;
+
+static uint64_t big_mul_w(uint64_t *hi, uint64_t a, uint64_t b);
+static uint64_t big_div_w(uint64_t *rem, uint64_t hi, uint64_t lo,
+                          uint64_t d);
+static int big_norm(const uint64_t *a, int n);
+static int big_cmp(const uint64_t *a, int an, const uint64_t *b, int bn);
+static uint64_t big_add_n(uint64_t *r, const uint64_t *a, int an,
+                          const uint64_t *b, int bn);
+static void big_sub_n(uint64_t *r, const uint64_t *a, int an,
+                      const uint64_t *b, int bn);
+static uint64_t big_mul_1(uint64_t *r, const uint64_t *a, int n, uint64_t m);
+static uint64_t big_div_1(uint64_t *q, const uint64_t *a, int n, uint64_t d);
+static void big_mul_school(uint64_t *r, const uint64_t *a, int an,
+                           const uint64_t *b, int bn);
+static int big_mul(uint64_t *r, const uint64_t *a, int an, const uint64_t *b,
+                   int bn);
+static int big_div(uint64_t *q, uint64_t *r, const uint64_t *a, int an,
+                   const uint64_t *b, int bn);
+static int big_conv(char *s, const uint64_t *a, int an, int k,
+                    uint64_t **pw, const int *pwn);
+static int big_prod(uint64_t **res, int *resn, const uint64_t *f, int n);
+static int big_fac_push(BigFac *fac, uint64_t x);
+static int big_fac_prod(uint64_t **res, int *resn, BigFac *fac);
+static int big_range(uint64_t **res, int *resn, uint64_t lo, uint64_t hi);
+static int big_ncr_primes(uint64_t **res, int *resn, int64_t n, int64_t k);
+static Big *big_new(int n);
+static int big_ref(BigRef *ref, const Num *num);
+static int big_set(Num *res, const uint64_t *a, int n, int neg);
+static int big_addsub(Num *res, const Num *args, int sub);
+
+int big_mode;
+
+static Big *bigs;
+static pthread_mutex_t bigs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 
+ * Double-width steps: a * b, returning the low limb and storing the high
+ * one in *hi, and (hi B + lo) / d for hi < d, storing the remainder in
+ * *rem. Compilers without a 128-bit type get them done by halves.
+ */
+static uint64_t
+big_mul_w(uint64_t *hi, uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	BigW t;
+
+	t = (BigW)a * b;
+	*hi = (uint64_t)(t >> 64);
+
+	return (uint64_t)t;
+#else
+	uint64_t p00, p01, p10, mid;
+
+	p00 = (a & 0xffffffff) * (b & 0xffffffff);
+	p01 = (a & 0xffffffff) * (b >> 32);
+	p10 = (a >> 32) * (b & 0xffffffff);
+	mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+	*hi = (a >> 32) * (b >> 32) + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+
+	return mid << 32 | (p00 & 0xffffffff);
+#endif
+}
+
+static uint64_t
+big_div_w(uint64_t *rem, uint64_t hi, uint64_t lo, uint64_t d)
+{
+#ifdef __SIZEOF_INT128__
+	BigW t;
+	uint64_t q;
+
+	t = (BigW)hi << 64 | lo;
+	q = (uint64_t)(t / d);
+	*rem = (uint64_t)(t - (BigW)q * d);
+
+	return q;
+#else
+	int i;
+	uint64_t q, top;
+
+	q = 0;
+	for (i = 0; i < 64; ++i) {
+		top = hi >> 63;
+		hi = hi << 1 | lo >> 63;
+		lo <<= 1;
+		q <<= 1;
+		if (top != 0 || hi >= d) {
+			hi -= d;
+			q |= 1;
+		}
+	}
+	*rem = hi;
+
+	return q;
+#endif
+}
+
+static int
+big_norm(const uint64_t *a, int n)
+{
+	while (n > 0 && a[n - 1] == 0)
+		--n;
+
+	return n;
+}
+
+static int
+big_cmp(const uint64_t *a, int an, const uint64_t *b, int bn)
+{
+	int i;
+
+	if (an != bn)
+		return (an < bn) ? -1 : 1;
+
+	for (i = an - 1; i >= 0; --i) {
+		if (a[i] != b[i])
+			return (a[i] < b[i]) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/* r = a + b with an >= bn, returning the carry out of r[an - 1] */
+static uint64_t
+big_add_n(uint64_t *r, const uint64_t *a, int an, const uint64_t *b, int bn)
+{
+	int i;
+	uint64_t c, s;
+
+	c = 0;
+	for (i = 0; i < bn; ++i) {
+		s = a[i] + c;
+		c = s < c;
+		r[i] = s + b[i];
+		c += r[i] < s;
+	}
+	for (; i < an; ++i) {
+		s = a[i] + c;
+		c = s < c;
+		r[i] = s;
+	}
+
+	return c;
+}
+
+/* r = a - b with an >= bn and a >= b */
+static void
+big_sub_n(uint64_t *r, const uint64_t *a, int an, const uint64_t *b, int bn)
+{
+	int i;
+	uint64_t bw, nb, d;
+
+	bw = 0;
+	for (i = 0; i < bn; ++i) {
+		nb = a[i] < b[i];
+		d = a[i] - b[i];
+		r[i] = d - bw;
+		bw = nb | (d < bw);
+	}
+	for (; i < an; ++i) {
+		d = a[i];
+		r[i] = d - bw;
+		bw = d < bw;
+	}
+}
+
+static uint64_t
+big_mul_1(uint64_t *r, const uint64_t *a, int n, uint64_t m)
+{
+	int i;
+	uint64_t c, hi, lo;
+
+	c = 0;
+	for (i = 0; i < n; ++i) {
+		lo = big_mul_w(&hi, a[i], m) + c;
+		r[i] = lo;
+		c = hi + (lo < c);
+	}
+
+	return c;
+}
+
+static uint64_t
+big_div_1(uint64_t *q, const uint64_t *a, int n, uint64_t d)
+{
+	int i;
+	uint64_t rem;
+
+	rem = 0;
+	for (i = n - 1; i >= 0; --i)
+		q[i] = big_div_w(&rem, rem, a[i], d);
+
+	return rem;
+}
+
+static void
+big_mul_school(uint64_t *r, const uint64_t *a, int an, const uint64_t *b,
+               int bn)
+{
+	int i, j;
+	uint64_t c, hi, lo;
+
+	memset(r, 0, (size_t)(an + bn) * sizeof(uint64_t));
+	for (j = 0; j < bn; ++j) {
+		c = 0;
+		for (i = 0; i < an; ++i) {
+			/* Can't overflow: (B - 1)^2 + 2 (B - 1) < B^2 */
+			lo = big_mul_w(&hi, a[i], b[j]) + c;
+			hi += lo < c;
+			lo += r[i + j];
+			hi += lo < r[i + j];
+			r[i + j] = lo;
+			c = hi;
+		}
+		r[an + j] = c;
+	}
+}
+
+/* r = a * b, an + bn limbs, where r doesn't overlap a or b */
+static int
+big_mul(uint64_t *r, const uint64_t *a, int an, const uint64_t *b, int bn)
+{
+	int m, sn, zn, ret;
+	uint64_t *t, *sa, *sb, *z1;
+
+	if (an < bn)
+		return big_mul(r, b, bn, a, an);
+
+	if (bn < BIG_KARATSUBA) {
+		big_mul_school(r, a, an, b, bn);
+		return 0;
+	}
+
+	m = (an + 1) / 2;
+	if (bn <= m) {
+		/* Too unbalanced to split both: a0 * b + (a1 * b) << m */
+		if ((t = malloc((size_t)(an - m + bn) * sizeof(uint64_t))) == NULL)
+			return -1;
+		ret = big_mul(r, a, m, b, bn);
+		memset(r + m + bn, 0, (size_t)(an - m) * sizeof(uint64_t));
+		if (ret == 0 && (ret = big_mul(t, a + m, an - m, b, bn)) == 0)
+			big_add_n(r + m, r + m, an + bn - m, t, an - m + bn);
+		free(t);
+		return ret;
+	}
+
+	/*
+	 * Karatsuba: with a = a1 B^m + a0 and b = b1 B^m + b0, the middle
+	 * term a0 b1 + a1 b0 is (a0 + a1)(b0 + b1) - a0 b0 - a1 b1, which
+	 * saves one of the four half-sized products.
+	 */
+	sn = m + 1;
+	if ((t = malloc((size_t)4 * sn * sizeof(uint64_t))) == NULL)
+		return -1;
+	sa = t;
+	sb = t + sn;
+	z1 = t + 2 * sn;
+	sa[m] = big_add_n(sa, a, m, a + m, an - m);
+	sb[m] = big_add_n(sb, b, m, b + m, bn - m);
+
+	ret = -1;
+	if (big_mul(r, a, m, b, m) < 0
+	    || big_mul(r + 2 * m, a + m, an - m, b + m, bn - m) < 0
+	    || big_mul(z1, sa, sn, sb, sn) < 0)
+		goto out;
+
+	big_sub_n(z1, z1, 2 * sn, r, 2 * m);
+	big_sub_n(z1, z1, 2 * sn, r + 2 * m, an + bn - 2 * m);
+	zn = big_norm(z1, 2 * sn);
+	big_add_n(r + m, r + m, an + bn - m, z1, zn);
+	ret = 0;
+
+out:
+	free(t);
+	return ret;
+}
+
+/*
+ * q = a / b and r = a % b for normalized a and nonzero b. q takes an + 1
+ * limbs and r takes bn limbs.
+ */
+static int
+big_div(uint64_t *q, uint64_t *r, const uint64_t *a, int an,
+        const uint64_t *b, int bn)
+{
+	int i, j, s, over;
+	uint64_t *un, *vn, c, bw, nb, qhat, rhat, hi, lo, d;
+
+	memset(q, 0, (size_t)(an + 1) * sizeof(uint64_t));
+	if (big_cmp(a, an, b, bn) < 0) {
+		memset(r, 0, (size_t)bn * sizeof(uint64_t));
+		memcpy(r, a, (size_t)an * sizeof(uint64_t));
+		return 0;
+	}
+
+	if (bn == 1) {
+		r[0] = big_div_1(q, a, an, b[0]);
+		return 0;
+	}
+
+	if ((un = malloc((size_t)(an + 1 + bn) * sizeof(uint64_t))) == NULL)
+		return -1;
+	vn = un + an + 1;
+
+	/* Knuth's algorithm D, with b shifted so that its top bit is set */
+	for (s = 0; (b[bn - 1] << s >> 63) == 0; ++s)
+		;
+	for (i = bn - 1; i > 0; --i)
+		vn[i] = (b[i] << s) | ((s != 0) ? b[i - 1] >> (64 - s) : 0);
+	vn[0] = b[0] << s;
+	un[an] = (s != 0) ? a[an - 1] >> (64 - s) : 0;
+	for (i = an - 1; i > 0; --i)
+		un[i] = (a[i] << s) | ((s != 0) ? a[i - 1] >> (64 - s) : 0);
+	un[0] = a[0] << s;
+
+	for (j = an - bn; j >= 0; --j) {
+		/* 
+		 * The top limb of un never exceeds vn's, and when they are equal
+		 * qhat is B - 1 at most, with rhat = un[j + bn - 1] + vn[bn - 1].
+		 */
+		if (un[j + bn] >= vn[bn - 1]) {
+			qhat = UINT64_MAX;
+			rhat = un[j + bn - 1] + vn[bn - 1];
+			over = rhat < vn[bn - 1];
+		} else {
+			qhat = big_div_w(&rhat, un[j + bn], un[j + bn - 1],
+			                 vn[bn - 1]);
+			over = 0;
+		}
+		while (over == 0) {
+			lo = big_mul_w(&hi, qhat, vn[bn - 2]);
+			if (hi < rhat || (hi == rhat && lo <= un[j + bn - 2]))
+				break;
+			--qhat;
+			rhat += vn[bn - 1];
+			over = rhat < vn[bn - 1];
+		}
+
+		c = bw = 0;
+		for (i = 0; i < bn; ++i) {
+			lo = big_mul_w(&hi, qhat, vn[i]) + c;
+			c = hi + (lo < c);
+			nb = un[i + j] < lo;
+			d = un[i + j] - lo;
+			un[i + j] = d - bw;
+			bw = nb | (d < bw);
+		}
+		nb = un[j + bn] < c;
+		d = un[j + bn] - c;
+		un[j + bn] = d - bw;
+		bw = nb | (d < bw);
+
+		q[j] = qhat;
+		if (bw != 0) {
+			/* qhat was one too large: add b back */
+			--q[j];
+			un[j + bn] += big_add_n(un + j, un + j, bn, vn, bn);
+		}
+	}
+
+	for (i = 0; i < bn - 1; ++i)
+		r[i] = (un[i] >> s) | ((s != 0) ? un[i + 1] << (64 - s) : 0);
+	r[bn - 1] = un[bn - 1] >> s;
+
+	free(un);
+
+	return 0;
+}
+
+/*
+ * Writes a, which must be below 10^(BIG_DIGITS 2^(k + 1)), as exactly
+ * that many digits. Splitting by pw[k] = 10^(BIG_DIGITS 2^k) halves the
+ * digits at each level, so most of the work goes into a few divisions
+ * of large numbers rather than one division by 10^BIG_DIGITS per chunk.
+ */
+static int
+big_conv(char *s, const uint64_t *a, int an, int k, uint64_t **pw,
+         const int *pwn)
+{
+	int i, j, w, ret;
+	uint64_t *q, *r, rem, tmp[BIG_CONV_LEAF];
+
+	w = BIG_DIGITS << (k + 1);
+	an = big_norm(a, an);
+	if (an <= BIG_CONV_LEAF) {
+		memcpy(tmp, a, (size_t)an * sizeof(uint64_t));
+		for (i = w; i > 0; i -= BIG_DIGITS) {
+			rem = 0;
+			if (an > 0) {
+				rem = big_div_1(tmp, tmp, an, BIG_CHUNK);
+				an = big_norm(tmp, an);
+			}
+			for (j = 1; j <= BIG_DIGITS; ++j) {
+				s[i - j] = '0' + rem % 10;
+				rem /= 10;
+			}
+		}
+		return 0;
+	}
+
+	q = malloc((size_t)(an + 1 + pwn[k]) * sizeof(uint64_t));
+	if (q == NULL)
+		return -1;
+	r = q + an + 1;
+
+	ret = -1;
+	if (big_div(q, r, a, an, pw[k], pwn[k]) == 0
+	    && big_conv(s, q, an + 1, k - 1, pw, pwn) == 0
+	    && big_conv(s + w / 2, r, pwn[k], k - 1, pw, pwn) == 0)
+		ret = 0;
+
+	free(q);
+
+	return ret;
+}
+
+/*
+ * Product of f[0..n), halving the range so that operands stay balanced.
+ * Products may take long, so the budget is checked at every step.
+ */
+static int
+big_prod(uint64_t **res, int *resn, const uint64_t *f, int n)
+{
+	int i, an, bn, ret;
+	uint64_t *r, *a, *b, c;
+
+	if (prog_poll() < 0)
+		return -1;
+
+	if (n <= BIG_LEAF) {
+		if ((r = malloc((size_t)(n + 1) * sizeof(uint64_t))) == NULL)
+			return -1;
+		r[0] = 1;
+		*resn = 1;
+		for (i = 0; i < n; ++i) {
+			if ((c = big_mul_1(r, r, *resn, f[i])) != 0)
+				r[(*resn)++] = c;
+		}
+		*res = r;
+		return 0;
+	}
+
+	if (big_prod(&a, &an, f, n / 2) < 0)
+		return -1;
+	if (big_prod(&b, &bn, f + n / 2, n - n / 2) < 0) {
+		free(a);
+		return -1;
+	}
+
+	ret = -1;
+	if ((r = malloc((size_t)(an + bn) * sizeof(uint64_t))) != NULL) {
+		if (big_mul(r, a, an, b, bn) == 0) {
+			*res = r;
+			*resn = big_norm(r, an + bn);
+			ret = 0;
+		} else {
+			free(r);
+		}
+	}
+	free(a);
+	free(b);
+
+	return ret;
+}
+
+static int
+big_fac_push(BigFac *fac, uint64_t x)
+{
+	uint64_t *tmp;
+
+	/* A zero x flushes the last accumulated factor. */
+	if (x != 0 && fac->acc <= UINT64_MAX / x) {
+		fac->acc *= x;
+		return 0;
+	}
+
+	if (fac->n == fac->size) {
+		fac->size = (fac->size > 0) ? 2 * fac->size : 256;
+		tmp = realloc(fac->f, (size_t)fac->size * sizeof(uint64_t));
+		if (tmp == NULL)
+			return -1;
+		fac->f = tmp;
+	}
+	fac->f[fac->n++] = fac->acc;
+	fac->acc = x;
+
+	return 0;
+}
+
+static int
+big_fac_prod(uint64_t **res, int *resn, BigFac *fac)
+{
+	int ret;
+
+	ret = -1;
+	if (big_fac_push(fac, 0) == 0)
+		ret = big_prod(res, resn, fac->f, fac->n);
+	free(fac->f);
+
+	return ret;
+}
+
+/* Product of the integers in (lo, hi], by binary splitting */
+static int
+big_range(uint64_t **res, int *resn, uint64_t lo, uint64_t hi)
+{
+	uint64_t i;
+	BigFac fac = { NULL, 0, 0, 1 };
+
+	for (i = lo + 1; i <= hi && i > lo; ++i) {
+		if (big_fac_push(&fac, i) < 0) {
+			free(fac.f);
+			return -1;
+		}
+	}
+
+	return big_fac_prod(res, resn, &fac);
+}
+
+/*
+ * Binomial coefficient as a product over primes p <= n, each raised to
+ * the number of carries when adding k and n - k in base p (Kummer), so
+ * that no division is needed.
+ */
+static int
+big_ncr_primes(uint64_t **res, int *resn, int64_t n, int64_t k)
+{
+	int64_t p, pk, i;
+	int e;
+	char *comp;
+	BigFac fac = { NULL, 0, 0, 1 };
+
+	if ((comp = calloc((size_t)n + 1, 1)) == NULL)
+		return -1;
+
+	for (p = 2; p <= n; ++p) {
+		if (comp[p] != 0)
+			continue;
+		for (i = p * p; i <= n; i += p)
+			comp[i] = 1;
+
+		e = 0;
+		for (pk = p; pk <= n; pk *= p)
+			e += n / pk - k / pk - (n - k) / pk;
+		while (e-- > 0) {
+			if (big_fac_push(&fac, p) < 0) {
+				free(comp);
+				free(fac.f);
+				return -1;
+			}
+		}
+	}
+	free(comp);
+
+	return big_fac_prod(res, resn, &fac);
+}
+
+static Big *
+big_new(int n)
+{
+	Big *b;
+
+	if (n > BIG_LIMBS_MAX)
+		return NULL;
+
+	b = malloc(sizeof(Big) + (size_t)n * sizeof(uint64_t));
+	if (b == NULL)
+		return NULL;
+
+	b->mark = 0;
+	b->neg = 0;
+	b->n = n;
+
+	/* Threads may create big integers while evaluating programs. */
+	pthread_mutex_lock(&bigs_lock);
+	b->next = bigs;
+	bigs = b;
+	pthread_mutex_unlock(&bigs_lock);
+
+	return b;
+}
+
+static int
+big_ref(BigRef *ref, const Num *num)
+{
+	switch (num->type) {
+	case NUM_INT:
+		ref->neg = num->v.i < 0;
+		ref->buf = (ref->neg != 0) ? 0 - (uint64_t)num->v.i
+		                           : (uint64_t)num->v.i;
+		ref->a = &ref->buf;
+		ref->n = ref->buf != 0;
+		return 0;
+	case NUM_BIG:
+		ref->neg = num->v.b->neg;
+		ref->a = num->v.b->a;
+		ref->n = num->v.b->n;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/* Stores a, an integer whenever it fits in one */
+static int
+big_set(Num *res, const uint64_t *a, int n, int neg)
+{
+	Big *b;
+
+	n = big_norm(a, n);
+	if (n == 0 || (n == 1 && a[0] <= (uint64_t)INT64_MAX + (neg != 0))) {
+		res->type = NUM_INT;
+		res->v.i = (n == 0) ? 0 : (int64_t)(a[0] - (neg != 0));
+		if (neg != 0)
+			res->v.i = -res->v.i - (n != 0);
+		res->d = (double)res->v.i;
+		return 0;
+	}
+
+	if ((b = big_new(n)) == NULL)
+		return -1;
+
+	memcpy(b->a, a, (size_t)n * sizeof(uint64_t));
+	b->neg = neg;
+
+	res->type = NUM_BIG;
+	res->v.b = b;
+	res->d = ldexp((double)a[n - 1], 64 * (n - 1));
+	if (n > 1)
+		res->d += ldexp((double)a[n - 2], 64 * (n - 2));
+	if (neg != 0)
+		res->d = -res->d;
+
+	return 0;
+}
+
+static int
+big_addsub(Num *res, const Num *args, int sub)
+{
+	int n, neg, ret;
+	uint64_t *r;
+	const BigRef *x, *y;
+	BigRef p, q;
+
+	if (big_ref(&p, &args[0]) < 0 || big_ref(&q, &args[1]) < 0)
+		return -1;
+	q.neg ^= sub;
+
+	n = ((p.n > q.n) ? p.n : q.n) + 1;
+	if ((r = malloc((size_t)n * sizeof(uint64_t))) == NULL)
+		return -1;
+
+	/* Magnitudes are added or subtracted, larger one first. */
+	x = (big_cmp(p.a, p.n, q.a, q.n) >= 0) ? &p : &q;
+	y = (x == &p) ? &q : &p;
+	if (p.neg == q.neg) {
+		r[n - 1] = 0;
+		r[x->n] = big_add_n(r, x->a, x->n, y->a, y->n);
+		neg = p.neg;
+	} else {
+		memset(r, 0, (size_t)n * sizeof(uint64_t));
+		big_sub_n(r, x->a, x->n, y->a, y->n);
+		neg = x->neg;
+	}
+
+	ret = big_set(res, r, n, neg);
+	free(r);
+
+	return ret;
+}
+
+void
+big_mark(Big *b)
+{
+	b->mark = 1;
+}
+
+void
+big_sweep(void)
+{
+	Big **ptr, *b;
+
+	/* Same rules as mat_sweep() */
+	ptr = &bigs;
+	while ((b = *ptr) != NULL) {
+		if (b->mark == 0) {
+			*ptr = b->next;
+			free(b);
+		} else {
+			b->mark = 0;
+			ptr = &b->next;
+		}
+	}
+}
+
+/* Returns a newly allocated string, which the caller must free */
+char *
+big_fmt(const Num *num)
+{
+	int i, k, w, pwn[BIG_POW_MAX];
+	char *s, *ptr;
+	uint64_t *pw[BIG_POW_MAX];
+	const Big *b;
+
+	/* Each limb takes less than 20 digits. */
+	b = num->v.b;
+	for (k = 0; (BIG_DIGITS << (k + 1)) < 20 * b->n; ++k)
+		;
+	w = BIG_DIGITS << (k + 1);
+
+	s = NULL;
+	pw[0] = NULL;
+	for (i = 0; i <= k; ++i) {
+		pwn[i] = (i == 0) ? 1 : 2 * pwn[i - 1];
+		pw[i] = malloc((size_t)pwn[i] * sizeof(uint64_t));
+		if (i < BIG_POW_MAX - 1)
+			pw[i + 1] = NULL;
+		if (pw[i] == NULL)
+			goto out;
+		if (i == 0)
+			pw[i][0] = BIG_CHUNK;
+		else if (big_mul(pw[i], pw[i - 1], pwn[i - 1], pw[i - 1],
+		                 pwn[i - 1]) < 0)
+			goto out;
+		pwn[i] = big_norm(pw[i], pwn[i]);
+	}
+
+	if ((s = malloc((size_t)w + 2)) == NULL)
+		goto out;
+	if (big_conv(s + 1, b->a, b->n, k, pw, pwn) < 0) {
+		free(s);
+		s = NULL;
+		goto out;
+	}
+	s[w + 1] = '\0';
+
+	for (ptr = s + 1; *ptr == '0' && ptr[1] != '\0'; ++ptr)
+		;
+	if (b->neg != 0)
+		*--ptr = '-';
+	memmove(s, ptr, strlen(ptr) + 1);
+
+out:
+	for (i = 0; i <= k && pw[i] != NULL; ++i)
+		free(pw[i]);
+
+	return s;
+}
+
+int
+big_add(Num *res, const Num *args)
+{
+	return big_addsub(res, args, 0);
+}
+
+int
+big_subst(Num *res, const Num *args)
+{
+	return big_addsub(res, args, 1);
+}
+
+int
+big_mult(Num *res, const Num *args)
+{
+	int ret;
+	uint64_t *r;
+	BigRef p, q;
+
+	if (big_ref(&p, &args[0]) < 0 || big_ref(&q, &args[1]) < 0)
+		return -1;
+
+	if (p.n == 0 || q.n == 0)
+		return big_set(res, NULL, 0, 0);
+
+	if (p.n + q.n > BIG_LIMBS_MAX + 1)
+		return -1;
+
+	if ((r = malloc((size_t)(p.n + q.n) * sizeof(uint64_t))) == NULL)
+		return -1;
+
+	ret = -1;
+	if (big_mul(r, p.a, p.n, q.a, q.n) == 0)
+		ret = big_set(res, r, p.n + q.n, p.neg ^ q.neg);
+	free(r);
+
+	return ret;
+}
+
+int
+big_mod(Num *res, const Num *args)
+{
+	int ret;
+	uint64_t *q;
+	BigRef p, d;
+
+	if (big_ref(&p, &args[0]) < 0 || big_ref(&d, &args[1]) < 0
+	    || d.n == 0)
+		return -1;
+
+	if (p.n == 0)
+		return big_set(res, NULL, 0, 0);
+
+	/* Truncated, like op_mod_i(): the result has the dividend's sign */
+	if ((q = malloc((size_t)(p.n + 1 + d.n) * sizeof(uint64_t))) == NULL)
+		return -1;
+
+	ret = -1;
+	if (big_div(q, q + p.n + 1, p.a, p.n, d.a, d.n) == 0)
+		ret = big_set(res, q + p.n + 1, d.n, p.neg);
+	free(q);
+
+	return ret;
+}
+
+int
+big_fact(Num *res, const Num *args)
+{
+	int rn, ret;
+	int64_t n;
+	uint64_t *r;
+
+	if (args[0].type != NUM_INT || (n = args[0].v.i) < 0)
+		return -1;
+
+	if (lgamma(n + 1.0) / log(2) / 64 > BIG_LIMBS_MAX)
+		return -1;
+
+	if (big_range(&r, &rn, 1, n) < 0)
+		return -1;
+	ret = big_set(res, r, rn, 0);
+	free(r);
+
+	return ret;
+}
+
+int
+big_npr(Num *res, const Num *args)
+{
+	int rn, ret;
+	int64_t n, k;
+	double bits;
+	uint64_t *r;
+
+	if (args[0].type != NUM_INT || args[1].type != NUM_INT)
+		return -1;
+
+	n = args[0].v.i;
+	k = args[1].v.i;
+	if (k < 0 || k > n)
+		return -1;
+
+	/* lgamma() loses the difference for large n, so bound it instead. */
+	if (n < INT32_MAX)
+		bits = (lgamma(n + 1.0) - lgamma(n - k + 1.0)) / log(2);
+	else
+		bits = k * log2(n);
+	if (bits / 64 > BIG_LIMBS_MAX)
+		return -1;
+
+	if (big_range(&r, &rn, n - k, n) < 0)
+		return -1;
+	ret = big_set(res, r, rn, 0);
+	free(r);
+
+	return ret;
+}
+
+int
+big_ncr(Num *res, const Num *args)
+{
+	int rn, fn, qn, ret;
+	int64_t n, k;
+	double bits;
+	uint64_t *r, *f, *q;
+
+	if (args[0].type != NUM_INT || args[1].type != NUM_INT)
+		return -1;
+
+	n = args[0].v.i;
+	k = args[1].v.i;
+	if (k < 0 || k > n)
+		return -1;
+	if (k > n - k)
+		k = n - k;
+
+	if (n < INT32_MAX)
+		bits = (lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0))
+		       / log(2);
+	else
+		bits = k * log2(n);
+	if (bits / 64 > BIG_LIMBS_MAX)
+		return -1;
+
+	if (n <= BIG_SIEVE_MAX) {
+		if (big_ncr_primes(&r, &rn, n, k) < 0)
+			return -1;
+		ret = big_set(res, r, rn, 0);
+		free(r);
+		return ret;
+	}
+
+	/* Too large to sieve, but then k is small: n!/(n - k)! over k! */
+	if (big_range(&r, &rn, n - k, n) < 0)
+		return -1;
+	if (big_range(&f, &fn, 1, k) < 0) {
+		free(r);
+		return -1;
+	}
+
+	ret = -1;
+	qn = rn + 1;
+	if ((q = malloc((size_t)(qn + fn) * sizeof(uint64_t))) != NULL) {
+		if (big_div(q, q + qn, r, rn, f, fn) == 0)
+			ret = big_set(res, q, qn, 0);
+		free(q);
+	}
+	free(r);
+	free(f);
+
+	return ret;
+}
@@ -0,0 +1,27 @@
+/* See LICENSE file for copyright and license details. */
+
+#define BIG_LIMBS_MAX 32768 /* About 630000 decimal digits */
+
+struct Big {
+	struct Big *next; /* All big integers are chained for the collector */
+	int mark;
+	int neg;
+	int n;
+	uint64_t a[]; /* Magnitude, least significant limb first */
+};
+
+typedef struct Big Big;
+
+void big_mark(Big *b);
+void big_sweep(void);
+char *big_fmt(const Num *num);
+
+int big_add(Num *res, const Num *args);
+int big_subst(Num *res, const Num *args);
+int big_mult(Num *res, const Num *args);
+int big_mod(Num *res, const Num *args);
+int big_fact(Num *res, const Num *args);
+int big_npr(Num *res, const Num *args);
+int big_ncr(Num *res, const Num *args);
+
+extern int big_mode;
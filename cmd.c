@@ -1,40 +1,120 @@
 /* See LICENSE for copyright and license details. */
 
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stddef.h> /* Dependency for strlcpy.h */
+#include <stdint.h> /* Dependency for num.h, op.h */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include "stack.h" /* Dependency for cmd.h */
+#include "num.h" /* Dependency for big.h, stack.h, mem.h, utils.h */
+#include "big.h"
+#include "stack.h" /* Dependency for cmd.h, mem.h */
 #include "cmd.h"
+#include "op.h" /* Dependency for prog.h */
+#include "prog.h" /* Dependency for fn.h, mem.h */
+#include "stat.h" /* Dependency for fn.h */
+#include "dec.h"
+#include "fn.h"
+#include "mat.h"
 #include "mem.h"
-#include "op.h"
+#include "par.h"
+#include "plugin.h"
+#include "rng.h"
 #include "sline.h"
 #include "strlcpy.h"
 #include "utils.h"
+#include "vec.h"
+
+#define MC_MAX 1000000000L /* Run cap for :mc */
+#define REP_MAX 1000000000L /* Iteration cap for :rep and :until */
+#define REP_COLLECT 4096 /* Iterations between collections */
+#define SWEEP_MAX 1000000000L /* Values swept at most */
+#define SWEEP_CHUNK 65536
+#define SWEEP_BATCH 256
+
+typedef struct {
+	const Prog *prog;
+	Num regs[MEM_SIZE];
+	int reg;
+	int deps[MEM_SIZE], deps_n; /* Bindings following reg */
+	double start, step;
+	long base;
+	Num *res;
+	int errs[PAR_THREADS_MAX];
+	int deg; /* Degree for polynomial batches, -1 otherwise */
+	int vec; /* Whether prog_vec_run() can be used */
+	double coefs[PROG_SIZE];
+} SweepCtx;
 
 static int get_args(const char *args, const char *fmt, ...);
+static int get_var(const char *args, int *off);
+static FILE *get_file(const char *args, const char *mode);
+static int rep_run(const char *expr, long n, double tol);
+static int sweep_poly(SweepCtx *sw);
+static int sweep_err(const SweepCtx *sw);
+static void sweep_poly_worker(SweepCtx *sw, long lo, long hi);
+static void sweep_vec_worker(SweepCtx *sw, long lo, long hi, int id);
+static void sweep_worker(void *ctx, long lo, long hi, int id);
 
+static int cmd_acc(const char *args);
+static int cmd_aclr(const char *args);
+static int cmd_big(const char *args);
+static int cmd_bind(const char *args);
+static int cmd_budget(const char *args);
 static int cmd_d(const char *args);
+static int cmd_dec(const char *args);
 static int cmd_dmp(const char *args);
 static int cmd_dup(const char *args);
+static int cmd_grad(const char *args);
+static int cmd_mc(const char *args);
 static int cmd_mclr(const char *args);
+static int cmd_mload(const char *args);
+static int cmd_integ(const char *args);
 static int cmd_list(const char *args);
+static int cmd_opt(const char *args);
 static int cmd_p(const char *args);
+static int cmd_rep(const char *args);
+static int cmd_root(const char *args);
 static int cmd_sav(const char *args);
+static int cmd_seed(const char *args);
+static int cmd_stat(const char *args);
+static int cmd_sweep(const char *args);
 static int cmd_swp(const char *args);
+static int cmd_until(const char *args);
 static int cmd_ver(const char *args);
 static int cmd_whatis(const char *args);
 
 static const CmdReg cmd_defs[] = {
+	{ ":acc", cmd_acc, "Move elements in stack to the accumulators." },
+	{ ":aclr", cmd_aclr, "Clear the accumulators." },
+	{ ":big", cmd_big, "Toggle exact big integer arithmetic." },
+	{ ":bind", cmd_bind, "Bind register to a program." },
+	{ ":budget", cmd_budget, "Set per-line operation and time budgets." },
 	{ ":d", cmd_d, "Drop the stack." },
+	{ ":dec", cmd_dec, "Set decimal mode scale, or turn it off." },
 	{ ":dmp", cmd_dmp, "Dump session to file." },
 	{ ":dup", cmd_dup, "Duplicate last element in stack." },
+	{ ":grad", cmd_grad, "Evaluate program and its partial derivatives." },
+	{ ":mc", cmd_mc, "Run program many times and average its results." },
 	{ ":mclr", cmd_mclr, "Clear all memory registers." },
+	{ ":mload", cmd_mload, "Load matrix from file." },
+	{ ":integ", cmd_integ, "Integrate program over an interval." },
 	{ ":list", cmd_list, "List all available operations." },
+	{ ":opt", cmd_opt, "Toggle optimizing programs before running them." },
 	{ ":p", cmd_p, "Print stack." },
+	{ ":rep", cmd_rep, "Run program on the stack a number of times." },
+	{ ":root", cmd_root, "Find root of program within an interval." },
 	{ ":sav", cmd_sav, "Save value to register." },
+	{ ":seed", cmd_seed, "Seed the random number generator." },
+	{ ":stat", cmd_stat, "Toggle accumulating results of each line." },
+	{ ":sweep", cmd_sweep, "Evaluate program over a range of values." },
 	{ ":swp", cmd_swp, "Swap the two last elements in stack." },
+	{ ":until", cmd_until, "Run program on the stack until it settles." },
 	{ ":ver", cmd_ver, "Shows scalc version information." },
 	{ ":whatis", cmd_whatis, "Show info on command or operation." },
 	{ "", NULL, "" }
@@ -59,6 +139,318 @@ get_args(const char *args, const char *fmt, ...)
 	return matches;
 }
 
+/* Slot of the variable named first in args, creating it if needed */
+static int
+get_var(const char *args, int *off)
+{
+	int start, end;
+	char name[MEM_NAME_SIZE];
+
+	/* Names are delimited by hand, as scanf() widths can't be macros. */
+	start = end = *off = -1;
+	get_args(args, " %n%*s%n %n", &start, &end, off);
+	if (end < 0) {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	if (end - start >= MEM_NAME_SIZE) {
+		err = MEM_ERR_NAME;
+		return -1;
+	}
+
+	memcpy(name, args + start, end - start);
+	name[end - start] = '\0';
+
+	return mem_intern(name);
+}
+
+/* Opens the file named by args, whose trailing blanks are dropped */
+static FILE *
+get_file(const char *args, const char *mode)
+{
+	size_t len;
+	char path[FILENAME_MAX];
+	FILE *fp;
+
+	len = (args != NULL) ? strlen(args) : 0;
+	while (len > 0 && isspace((unsigned char)args[len - 1]))
+		--len;
+	if (len == 0) {
+		err = CMD_ERR_FEW_ARGS;
+		return NULL;
+	}
+
+	if (len >= sizeof(path)) {
+		errno = ENAMETOOLONG;
+		err = CMD_ERR_FILE_IO;
+		return NULL;
+	}
+
+	memcpy(path, args, len);
+	path[len] = '\0';
+
+	if ((fp = fopen(path, mode)) == NULL) {
+		err = CMD_ERR_FILE_IO;
+		return NULL;
+	}
+
+	return fp;
+}
+
+static int
+sweep_err(const SweepCtx *sw)
+{
+	int i;
+
+	for (i = 0; i < PAR_THREADS_MAX; ++i) {
+		if (sw->errs[i] != NO_ERR)
+			return sw->errs[i];
+	}
+
+	return NO_ERR;
+}
+
+static int
+rep_run(const char *expr, long n, double tol)
+{
+	long i;
+	double prev;
+	Prog prog;
+	Stack start;
+
+	if (n < 1 || n > REP_MAX) {
+		err = CMD_ERR_BAD_ARGS;
+		return -1;
+	}
+
+	if (prog_compile(&prog, expr) < 0)
+		return -1;
+	prog_opt(&prog);
+
+	/*
+	 * The program is compiled once and run straight on the stack. A
+	 * negative tol runs it n times, otherwise it stops as soon as the
+	 * top of the stack changes by no more than tol. Garbage is collected
+	 * along the way, keeping what the stack held before, as aborted lines
+	 * get it back, and the constants folded into the program.
+	 */
+	start = stack;
+	for (i = 0; i < n; ++i) {
+		prev = (stack.sp >= 0) ? stack.elems[stack.sp] : NAN;
+		if (prog_run(&prog, &stack, NULL, NULL) < 0) {
+			fprintf(stderr, "%s: stopped at iteration %ld.\n",
+			        (tol < 0) ? "rep" : "until", i + 1);
+			return -1;
+		}
+
+		if (tol >= 0 && stack.sp >= 0
+		    && fabs(stack.elems[stack.sp] - prev) <= tol) {
+			++i;
+			break;
+		}
+
+		if ((i + 1) % REP_COLLECT == 0)
+			mem_collect(&start, &prog);
+	}
+
+	if (tol >= 0)
+		fprintf(stderr, "until: %ld iterations.\n", i);
+
+	return cmd_p(NULL);
+}
+
+static int
+sweep_poly(SweepCtx *sw)
+{
+	int i, n;
+	const ProgIns *ins;
+
+	/* 
+	 * Programs of the form "reg a_n ... a_0 n poly" are evaluated in
+	 * batches of x values instead of running them once for each.
+	 */
+	ins = sw->prog->ins;
+	n = sw->prog->n - 4;
+	if (n < 0 || ins[0].type != PROG_REG
+	    || ins[0].arg.reg != sw->reg
+	    || ins[n + 3].type != PROG_OP
+	    || strcmp(ins[n + 3].arg.op->id, "poly") != 0
+	    || ins[n + 2].type != PROG_NUM || ins[n + 2].arg.num.d != n)
+		return -1;
+
+	for (i = 0; i <= n; ++i) {
+		if (ins[i + 1].type != PROG_NUM || ins[i + 1].arg.num.type == NUM_MAT)
+			return -1;
+		sw->coefs[i] = ins[i + 1].arg.num.d;
+	}
+
+	return n;
+}
+
+static void
+sweep_poly_worker(SweepCtx *sw, long lo, long hi)
+{
+	long i, j, end;
+	double x[SWEEP_BATCH], y[SWEEP_BATCH];
+
+	for (i = lo; i < hi; i += SWEEP_BATCH) {
+		end = (i + SWEEP_BATCH < hi) ? i + SWEEP_BATCH : hi;
+		for (j = i; j < end; ++j)
+			x[j - i] = sw->start + (double)(sw->base + j) * sw->step;
+
+		vec_poly(y, x, end - i, sw->coefs, sw->deg);
+		for (j = i; j < end; ++j) {
+			sw->res[j].type = NUM_DBL;
+			sw->res[j].d = y[j - i];
+		}
+	}
+}
+
+static void
+sweep_vec_worker(SweepCtx *sw, long lo, long hi, int id)
+{
+	long i, j, end;
+	double x[SWEEP_BATCH], y[SWEEP_BATCH];
+
+	for (i = lo; i < hi; i += SWEEP_BATCH) {
+		end = (i + SWEEP_BATCH < hi) ? i + SWEEP_BATCH : hi;
+		for (j = i; j < end; ++j)
+			x[j - i] = sw->start + (double)(sw->base + j) * sw->step;
+
+		if (prog_vec_run(sw->prog, sw->reg, y, x, end - i) < 0) {
+			if (sw->errs[id] == NO_ERR)
+				sw->errs[id] = err;
+			for (j = i; j < end; ++j)
+				y[j - i] = NAN;
+		}
+		for (j = i; j < end; ++j) {
+			sw->res[j].type = NUM_DBL;
+			sw->res[j].d = y[j - i];
+		}
+	}
+}
+
+static void
+sweep_worker(void *ctx, long lo, long hi, int id)
+{
+	int res;
+	long i;
+	Num regs[MEM_SIZE];
+	Stack st;
+	SweepCtx *sw;
+
+	sw = ctx;
+	if (sw->deg >= 0) {
+		sweep_poly_worker(sw, lo, hi);
+		return;
+	}
+
+	if (sw->vec) {
+		sweep_vec_worker(sw, lo, hi, id);
+		return;
+	}
+
+	memcpy(regs, sw->regs, sizeof(regs));
+	regs[sw->reg].type = NUM_DBL;
+	for (i = lo; i < hi; ++i) {
+		/* x is computed from i so that no rounding error accumulates. */
+		regs[sw->reg].d = sw->start + (double)(sw->base + i) * sw->step;
+
+		st.sp = -1;
+		res = mem_follow(regs, sw->deps, sw->deps_n);
+		if (res == 0 && (res = prog_run(sw->prog, &st, regs, NULL)) == 0
+		    && st.sp < 0) {
+			err = STACK_ERR_MIN;
+			res = -1;
+		}
+
+		if (res < 0) {
+			if (sw->errs[id] == NO_ERR)
+				sw->errs[id] = err;
+			sw->res[i].type = NUM_DBL;
+			sw->res[i].d = NAN;
+			continue;
+		}
+
+		sw->res[i].type = st.type[st.sp];
+		sw->res[i].d = st.elems[st.sp];
+		sw->res[i].v = st.vals[st.sp];
+	}
+}
+
+static int
+cmd_acc(const char *args)
+{
+	int n, i;
+
+	if (get_args(args, "%d", &n) < 0)
+		n = 1;
+
+	if (n < 0)
+		n = stack.sp + 1;
+
+	if (n > stack.sp + 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	for (i = stack.sp - n + 1; i <= stack.sp; ++i)
+		stat_add(&stat_acc, stack.elems[i]);
+
+	return stack_drop(n);
+}
+
+static int
+cmd_aclr(const char *args)
+{
+	get_args(args, NULL);
+
+	stat_clr(&stat_acc);
+
+	return 0;
+}
+
+static int
+cmd_big(const char *args)
+{
+	get_args(args, NULL);
+
+	big_mode = !big_mode;
+	printf("big: %s\n", (big_mode != 0) ? "on" : "off");
+
+	return 0;
+}
+
+static int
+cmd_bind(const char *args)
+{
+	int i, off;
+
+	if ((i = get_var(args, &off)) < 0)
+		return -1;
+
+	/* No program means unbinding. */
+	if (args[off] == '\0')
+		return mem_bind(i, NULL);
+
+	return mem_bind(i, args + off);
+}
+
+static int
+cmd_budget(const char *args)
+{
+	long ops, ms;
+
+	/* Missing budgets, or those 0 or less, mean no limit. */
+	ops = 0;
+	ms = 0;
+	get_args(args, "%ld %ld", &ops, &ms);
+	prog_budget(ops, ms);
+
+	return 0;
+}
+
 static int
 cmd_d(const char *args)
 {
@@ -76,6 +468,25 @@ cmd_d(const char *args)
 	return 0;
 }
 
+static int
+cmd_dec(const char *args)
+{
+	int scale;
+
+	/* No scale, or a negative one, turns decimal mode off. */
+	if (get_args(args, "%d", &scale) < 1)
+		scale = -1;
+
+	if (scale > DEC_SCALE_MAX) {
+		err = CMD_ERR_BAD_ARGS;
+		return -1;
+	}
+
+	dec_scale = (scale < 0) ? -1 : scale;
+
+	return 0;
+}
+
 static int
 cmd_dmp(const char *args)
 {
@@ -83,15 +494,8 @@ cmd_dmp(const char *args)
 	FILE *fp;
 	const char *hist_ptr;
 
-	if (args == NULL || strlen(args) == 0) {
-		err = CMD_ERR_FEW_ARGS;
+	if ((fp = get_file(args, "w")) == NULL)
 		return -1;
-	}
-
-	if ((fp = fopen(args, "w")) == NULL) {
-		err = CMD_ERR_FILE_IO;
-		return -1;
-	}
 
 	for (i = 0; (hist_ptr = sline_history_get(i)) != NULL; ++i) {
 		/* We skip commands and blank lines */
@@ -114,6 +518,108 @@ cmd_dup(const char *args)
 	return stack_dup();
 }
 
+static int
+cmd_grad(const char *args)
+{
+	int i, n, start, end, off, seeds[STACK_GRAD_MAX];
+	char names[STACK_GRAD_MAX * MEM_NAME_SIZE], *name, count[16];
+	DualStack st;
+	Prog prog;
+
+	/* Registers to differentiate with respect to, as in "x,y". */
+	start = end = off = -1;
+	get_args(args, " %n%*s%n %n", &start, &end, &off);
+	if (end < 0 || off < 0 || args[off] == '\0') {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	if (end - start >= (int)sizeof(names)) {
+		err = CMD_ERR_BAD_ARGS;
+		return -1;
+	}
+
+	memcpy(names, args + start, end - start);
+	names[end - start] = '\0';
+	n = 0;
+	for (name = strtok(names, ","); name != NULL;
+	     name = strtok(NULL, ",")) {
+		if (n == STACK_GRAD_MAX) {
+			err = CMD_ERR_BAD_ARGS;
+			return -1;
+		}
+		if ((seeds[n++] = mem_intern(name)) < 0)
+			return -1;
+	}
+
+	if (n == 0) {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	if (prog_compile(&prog, args + off) < 0)
+		return -1;
+	prog_opt(&prog);
+
+	st.sp = -1;
+	st.n = n;
+	if (prog_grad(&prog, &st, seeds, NULL) < 0)
+		return -1;
+
+	if (st.sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	/* The value first, then one partial derivative per register. */
+	if (stack_push(st.elems[st.sp]) < 0)
+		return -1;
+	for (i = 0; i < n; ++i) {
+		if (stack_push(st.grad[st.sp][i]) < 0)
+			return -1;
+	}
+
+	snprintf(count, sizeof(count), "%d", n + 1);
+
+	return cmd_p(count);
+}
+
+static int
+cmd_mc(const char *args)
+{
+	int off;
+	long n;
+	StatAcc acc;
+	Prog prog;
+
+	off = -1;
+	if (get_args(args, "%ld %n", &n, &off) < 1 || off < 0
+	    || args[off] == '\0') {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	if (n < 1 || n > MC_MAX) {
+		err = CMD_ERR_BAD_ARGS;
+		return -1;
+	}
+
+	if (prog_compile(&prog, args + off) < 0)
+		return -1;
+	prog_opt(&prog);
+
+	if (fn_mc(&acc, &prog, n) < 0)
+		return -1;
+
+	/* Results are also left in the accumulators, see var and stddev. */
+	stat_merge(&stat_acc, &acc);
+	fprintf(stderr, "mc: %ld runs, variance %g.\n", n, stat_var(&acc));
+	if (stack_push(stat_mean(&acc)) < 0)
+		return -1;
+
+	return cmd_p(NULL);
+}
+
 static int
 cmd_mclr(const char *args)
 {
@@ -122,25 +628,150 @@ cmd_mclr(const char *args)
 	return mem_clr(); 
 }
 
+static int
+cmd_mload(const char *args)
+{
+	FILE *fp;
+	char *line, *ptr, *endptr;
+	size_t line_size;
+	int rows, cols, n, size;
+	double val, *vals, *tmp;
+	Num num;
+
+	if ((fp = get_file(args, "r")) == NULL)
+		return -1;
+
+	/* One row per line, with elements separated by blanks */
+	line = NULL;
+	line_size = 0;
+	vals = NULL;
+	rows = cols = n = size = 0;
+	while (getline(&line, &line_size, fp) > 0) {
+		for (ptr = line; ; ptr = endptr) {
+			val = strtod(ptr, &endptr);
+			if (endptr == ptr)
+				break;
+
+			/* Rows are no wider than the first one, nor MAT_DIM_MAX. */
+			if (n - rows * cols == (rows == 0 ? MAT_DIM_MAX : cols)) {
+				err = OP_ERR_DIM;
+				goto fail;
+			}
+
+			if (n == size) {
+				size += MAT_DIM_MAX;
+				if ((tmp = realloc(vals, size * sizeof(double))) == NULL) {
+					err = MEM_ERR_ALLOC;
+					goto fail;
+				}
+				vals = tmp;
+			}
+			vals[n++] = val;
+		}
+
+		if (n == rows * cols) /* Blank line */
+			continue;
+
+		if (rows == 0)
+			cols = n;
+		if (n != (rows + 1) * cols || ++rows > MAT_DIM_MAX) {
+			err = OP_ERR_DIM;
+			goto fail;
+		}
+	}
+
+	if (rows == 0) {
+		err = OP_ERR_DIM;
+		goto fail;
+	}
+
+	num.type = NUM_MAT;
+	num.d = NAN;
+	if ((num.v.m = mat_new(rows, cols)) == NULL) {
+		err = MEM_ERR_ALLOC;
+		goto fail;
+	}
+	memcpy(num.v.m->a, vals, n * sizeof(double));
+
+	free(line);
+	free(vals);
+	fclose(fp);
+
+	return stack_push_num(&num);
+
+fail:
+	free(line);
+	free(vals);
+	fclose(fp);
+
+	return -1;
+}
+
+static int
+cmd_integ(const char *args)
+{
+	int off;
+	long evals;
+	double a, b, res;
+	Prog prog;
+
+	off = -1;
+	if (get_args(args, "%lf %lf %n", &a, &b, &off) < 2 || off < 0
+	    || args[off] == '\0') {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	if (prog_compile(&prog, args + off) < 0)
+		return -1;
+	prog_opt(&prog);
+
+	if (fn_integ(&res, &prog, a, b, &evals) < 0)
+		return -1;
+
+	fprintf(stderr, "integ: %ld evaluations.\n", evals);
+	if (stack_push(res) < 0)
+		return -1;
+
+	return cmd_p(NULL);
+}
+
 static int
 cmd_list(const char *args)
 {
+	int i;
 	const OpReg *ptr;
 
 	get_args(args, NULL);
 
 	for (ptr = op_defs; strncmp(ptr->id, "", OP_NAME_SIZE) != 0; ++ptr)
 		printf("%s ", ptr->id);
+	for (i = 0; plugin_ops(i) != NULL; ++i) {
+		for (ptr = plugin_ops(i); op_valid(ptr) == 0; ++ptr)
+			printf("%s ", ptr->id);
+	}
 	putchar('\n');
 
 	return 0;
 }
 
+static int
+cmd_opt(const char *args)
+{
+	get_args(args, NULL);
+
+	prog_optimize = !prog_optimize;
+	printf("opt: %s (%ld ops eliminated)\n",
+	       (prog_optimize != 0) ? "on" : "off", prog_eliminated);
+
+	return 0;
+}
+
 static int
 cmd_p(const char *args)
 {
 	int n;
-	double buf;
+	Num buf;
 	
 	if (get_args(args, "%d", &n) < 0)
 		n = 1;
@@ -152,32 +783,167 @@ cmd_p(const char *args)
 		--n; /* Substract one so n becomes an array index. */
 
 	while (n >= 0) {
-		buf = 0.0;
-		if (stack_peek(&buf, n) < 0)
+		if (stack_peek_num(&buf, n) < 0)
 			return -1;
 
-		print_num(buf);
+		print_num(&buf);
 		--n;
 	}
 
 	return 0;
 }
 
+static int
+cmd_rep(const char *args)
+{
+	int off;
+	long n;
+
+	off = -1;
+	if (get_args(args, "%ld %n", &n, &off) < 1 || off < 0
+	    || args[off] == '\0') {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	return rep_run(args + off, n, -1);
+}
+
+static int
+cmd_root(const char *args)
+{
+	int off;
+	long evals;
+	double a, b, res;
+	Prog prog;
+
+	off = -1;
+	if (get_args(args, "%lf %lf %n", &a, &b, &off) < 2 || off < 0
+	    || args[off] == '\0') {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	if (prog_compile(&prog, args + off) < 0)
+		return -1;
+	prog_opt(&prog);
+
+	if (fn_root(&res, &prog, a, b, &evals) < 0)
+		return -1;
+
+	fprintf(stderr, "root: %ld evaluations.\n", evals);
+	if (stack_push(res) < 0)
+		return -1;
+
+	return cmd_p(NULL);
+}
+
 static int
 cmd_sav(const char *args)
 {
-	char var;
-	double buf;
+	int i, off;
+	Num buf;
+
+	if ((i = get_var(args, &off)) < 0)
+		return -1;
+
+	if (stack_peek_num(&buf, 0) < 0)
+		return -1;
+
+	return mem_set_num(i, &buf);
+}
 
-	if (get_args(args, "%c", &var) < 0) {
+static int
+cmd_seed(const char *args)
+{
+	uint64_t seed;
+
+	if (get_args(args, "%" SCNu64, &seed) < 1) {
 		err = CMD_ERR_FEW_ARGS;
 		return -1;
 	}
 
-	if (stack_peek(&buf, 0) < 0)
+	rng_seed(seed);
+
+	return 0;
+}
+
+static int
+cmd_stat(const char *args)
+{
+	get_args(args, NULL);
+
+	stat_stream = !stat_stream;
+	printf("stat: %s\n", (stat_stream != 0) ? "on" : "off");
+
+	return 0;
+}
+
+static int
+cmd_sweep(const char *args)
+{
+	static Num buf[SWEEP_CHUNK];
+
+	int i, off;
+	long n, chunk;
+	double stop, span;
+	Prog prog;
+	SweepCtx sw;
+
+	if ((sw.reg = get_var(args, &off)) < 0)
+		return -1;
+
+	args += off;
+	off = -1;
+	if (get_args(args, "%lf %lf %lf %n", &sw.start, &stop, &sw.step,
+	             &off) < 3 || off < 0 || args[off] == '\0') {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	/* Written so that NaN fails too, before it reaches the cast. */
+	span = (stop - sw.start) / sw.step;
+	if (sw.step == 0 || !(span >= 0 && span < SWEEP_MAX)) {
+		err = CMD_ERR_BAD_ARGS;
+		return -1;
+	}
+
+	/* The tolerance keeps stop itself in range despite rounding. */
+	n = (long)floor(span + 1e-9) + 1;
+
+	if (prog_compile(&prog, args + off) < 0)
+		return -1;
+	prog_opt(&prog);
+
+	sw.prog = &prog;
+	sw.res = buf;
+	sw.deg = sweep_poly(&sw);
+	sw.vec = (prog_vec_check(&prog, sw.reg) == 0);
+	mem_copy(sw.regs);
+	sw.deps_n = mem_deps(sw.reg, sw.deps);
+	memset(sw.errs, NO_ERR, sizeof(sw.errs));
+
+	/*
+	 * The range is evaluated in chunks, each of them split across all
+	 * threads, and printed in order once done. Memory use is therefore
+	 * bounded by SWEEP_CHUNK no matter how many values are swept.
+	 */
+	for (sw.base = 0; sw.base < n; sw.base += chunk) {
+		chunk = (n - sw.base < SWEEP_CHUNK) ? n - sw.base : SWEEP_CHUNK;
+		par_for(chunk, sweep_worker, &sw);
+		for (i = 0; i < chunk; ++i)
+			print_num(&buf[i]);
+
+		/* Aborted sweeps stop right away, not at the end of the range. */
+		if (sweep_err(&sw) == PROG_ERR_BUDGET
+		    || sweep_err(&sw) == PROG_ERR_INTR)
+			break;
+	}
+
+	if ((err = sweep_err(&sw)) != NO_ERR)
 		return -1;
 
-	return mem_set(var, buf);
+	return 0;
 }
 
 static int
@@ -188,6 +954,28 @@ cmd_swp(const char *args)
 	return stack_swap();
 }
 
+static int
+cmd_until(const char *args)
+{
+	int off;
+	long n;
+	double tol;
+
+	off = -1;
+	if (get_args(args, "%ld %lf %n", &n, &tol, &off) < 2 || off < 0
+	    || args[off] == '\0') {
+		err = CMD_ERR_FEW_ARGS;
+		return -1;
+	}
+
+	if (tol < 0) {
+		err = CMD_ERR_BAD_ARGS;
+		return -1;
+	}
+
+	return rep_run(args + off, n, tol);
+}
+
 static int
 cmd_ver(const char *args)
 {
@@ -203,16 +991,28 @@ cmd_whatis(const char *args)
 {
 	const OpReg *op_ptr;
 	const CmdReg *cmd_ptr;
+	int start, end;
 	char query[OP_DESC_SIZE];
 	const char *id, *desc;
 
-	if (get_args(args, "%s", query) < 0) {
+	/* Delimited by hand, like in get_var(); no name is that long. */
+	start = end = -1;
+	get_args(args, " %n%*s%n", &start, &end);
+	if (end < 0) {
 		err = CMD_ERR_FEW_ARGS;
 		return -1;
 	}
 
-	if (args[0] == ':') {
-		cmd_ptr = cmd(args);
+	if (end - start >= OP_DESC_SIZE) {
+		err = CMD_ERR_WHATIS_NOT_FOUND;
+		return -1;
+	}
+
+	memcpy(query, args + start, end - start);
+	query[end - start] = '\0';
+
+	if (query[0] == ':') {
+		cmd_ptr = cmd(query);
 		if (cmd_valid(cmd_ptr) < 0) {
 			err = CMD_ERR_WHATIS_NOT_FOUND;
 			return -1;
@@ -221,7 +1021,7 @@ cmd_whatis(const char *args)
 		id = cmd_ptr->id;
 		desc = cmd_ptr->desc;
 	} else {
-		op_ptr = op(args);
+		op_ptr = op(query);
 		if (op_valid(op_ptr) < 0) {
 			err = CMD_ERR_WHATIS_NOT_FOUND;
 			return -1;
@@ -3,3 +3,22 @@
 /* SCALC_PREC: Controls the precision after the decimal point. */
 #define SCALC_PREC "9"
 
+/* 
+ * SCALC_THREADS: Number of threads used by parallel commands, such as
+ * :sweep. If 0 or less, one thread per online CPU is used.
+ */
+#define SCALC_THREADS 0
+
+/* 
+ * SCALC_PLUGIN_DIR: Directory where operation plugins are loaded from,
+ * unless overriden by the SCALC_PLUGIN_DIR environment variable.
+ */
+#define SCALC_PLUGIN_DIR "/usr/local/lib/scalc"
+
+/*
+ * SCALC_OPS_MAX, SCALC_TIME_MAX: Budgets for the number of operations and
+ * the wall time, in milliseconds, a single line may take before being
+ * aborted. If 0 or less, there's no limit.
+ */
+#define SCALC_OPS_MAX 0
+#define SCALC_TIME_MAX 0
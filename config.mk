@@ -8,9 +8,12 @@ PREFIX = /usr/local
 MANPREFIX = ${PREFIX}/man
 
 # Libraries
-LIBS = -lm -lsline
+LIBS = -lm -ldl -lpthread -lsline
+# OpenBSD (dlopen(3) is part of libc)
+#LIBS = -lm -lpthread -lsline
 
 # Flags
+# Besides C99, the compiler must support __thread (GCC and Clang do).
 CPPFLAGS = -I${PREFIX}/include -DVERSION=\"${VERSION}\" -D_POSIX_C_SOURCE=200809L
 #CFLAGS = -g -std=c99 -Wpedantic -Wall -Wextra
 CFLAGS = -std=c99 -Wpedantic -Wall -Wextra
@@ -0,0 +1,365 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <limits.h>
+#include <stdint.h> /* Dependency for num.h */
+#include <string.h>
+
+#include "num.h" /* Dependency for dec.h */
+#include "dec.h"
+
+/* DecH is half as wide as DecU, for wide products and quotients. */
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 DecU;
+typedef uint64_t DecH;
+#else
+typedef uint64_t DecU;
+typedef uint32_t DecH;
+#endif
+
+#define DEC_MAX ((DecU)-1 >> 1)
+#define DEC_H_BITS ((int)sizeof(DecH) * CHAR_BIT)
+
+static DecU dec_pow10(int n);
+static int dec_round(DecU *q, DecU r, DecU d);
+static int dec_pack(NumDec *res, DecU mag, int neg);
+static int dec_rescale(NumDec *res, NumDec val, int from, int to);
+static void dec_mul_wide(DecH *res, DecU p, DecU q);
+static DecU dec_div_wide(DecH *num, DecU d, DecU *rem);
+
+int dec_scale = -1; /* Decimal mode is off while negative */
+
+static DecU
+dec_pow10(int n)
+{
+	DecU res;
+
+	for (res = 1; n > 0; --n)
+		res *= 10;
+
+	return res;
+}
+
+static int
+dec_round(DecU *q, DecU r, DecU d)
+{
+	/* Banker's rounding: halves go to the even neighbor. */
+	if (r > d - r || (r == d - r && (*q & 1) != 0)) {
+		if (*q == DEC_MAX)
+			return -1;
+		++*q;
+	}
+
+	return 0;
+}
+
+static int
+dec_pack(NumDec *res, DecU mag, int neg)
+{
+	if (mag > DEC_MAX)
+		return -1;
+
+	*res = (neg != 0) ? -(NumDec)mag : (NumDec)mag;
+
+	return 0;
+}
+
+static int
+dec_rescale(NumDec *res, NumDec val, int from, int to)
+{
+	DecU mag, d, q;
+	int neg;
+
+	neg = val < 0;
+	mag = (neg != 0) ? -(DecU)val : (DecU)val;
+	if (to >= from) {
+		d = dec_pow10(to - from);
+		if (mag > DEC_MAX / d)
+			return -1;
+		return dec_pack(res, mag * d, neg);
+	}
+
+	d = dec_pow10(from - to);
+	q = mag / d;
+	if (dec_round(&q, mag % d, d) < 0)
+		return -1;
+
+	return dec_pack(res, q, neg);
+}
+
+static void
+dec_mul_wide(DecH *res, DecU p, DecU q)
+{
+	int i, j;
+	DecH a[2], b[2];
+	DecU t, carry;
+
+	/* Full double-width product, as four little-endian DecH limbs */
+	a[0] = (DecH)p;
+	a[1] = (DecH)(p >> DEC_H_BITS);
+	b[0] = (DecH)q;
+	b[1] = (DecH)(q >> DEC_H_BITS);
+	memset(res, 0, 4 * sizeof(DecH));
+	for (i = 0; i < 2; ++i) {
+		carry = 0;
+		for (j = 0; j < 2; ++j) {
+			t = (DecU)a[i] * b[j] + res[i + j] + carry;
+			res[i + j] = (DecH)t;
+			carry = t >> DEC_H_BITS;
+		}
+		res[i + 2] = (DecH)carry;
+	}
+}
+
+static DecU
+dec_div_wide(DecH *num, DecU d, DecU *rem)
+{
+	int i;
+	DecU q, r;
+
+	/* 
+	 * Quotient of a double-width numerator, assuming it fits in a DecU
+	 * (callers check), by plain shift-and-subtract division.
+	 */
+	if (num[2] == 0 && num[3] == 0) {
+		r = (DecU)num[1] << DEC_H_BITS | num[0];
+		*rem = r % d;
+		return r / d;
+	}
+
+	q = r = 0;
+	for (i = 4 * DEC_H_BITS - 1; i >= 0; --i) {
+		/* r < d always holds, so 2r + 1 only overflows if r's top bit is set */
+		if ((r >> (2 * DEC_H_BITS - 1)) != 0) {
+			r = (r << 1 | ((num[i / DEC_H_BITS] >> (i % DEC_H_BITS)) & 1))
+			    - d;
+			q = q << 1 | 1;
+			continue;
+		}
+
+		r = r << 1 | ((num[i / DEC_H_BITS] >> (i % DEC_H_BITS)) & 1);
+		q <<= 1;
+		if (r >= d) {
+			r -= d;
+			q |= 1;
+		}
+	}
+
+	*rem = r;
+
+	return q;
+}
+
+int
+dec_parse(Num *res, const char *str)
+{
+	int neg, digits, frac, round_digit, sticky;
+	const char *ptr;
+	DecU mag, q;
+
+	if (dec_scale < 0)
+		return -1;
+
+	ptr = str;
+	neg = *ptr == '-';
+	if (*ptr == '-' || *ptr == '+')
+		++ptr;
+
+	/* Digits past the scale only matter for rounding. */
+	mag = 0;
+	digits = 0;
+	frac = -1;
+	round_digit = -1;
+	sticky = 0;
+	for (; *ptr != '\0'; ++ptr) {
+		if (*ptr == '.' && frac < 0) {
+			frac = 0;
+			continue;
+		}
+
+		if (*ptr < '0' || *ptr > '9')
+			return -1;
+
+		++digits;
+		if (frac >= dec_scale) {
+			if (round_digit < 0)
+				round_digit = *ptr - '0';
+			else if (*ptr != '0')
+				sticky = 1;
+			continue;
+		}
+
+		if (mag > (DEC_MAX - 9) / 10)
+			return -1;
+		mag = mag * 10 + (*ptr - '0');
+		if (frac >= 0)
+			++frac;
+	}
+
+	if (digits == 0)
+		return -1;
+
+	if (frac < 0)
+		frac = 0;
+
+	q = dec_pow10(dec_scale - frac);
+	if (mag > DEC_MAX / q)
+		return -1;
+	mag *= q;
+
+	if (round_digit > 5 || (round_digit == 5 && (sticky != 0 || (mag & 1) != 0))) {
+		if (mag == DEC_MAX)
+			return -1;
+		++mag;
+	}
+
+	if (dec_pack(&res->v.dec.val, mag, neg) < 0)
+		return -1;
+
+	dec_set(res, res->v.dec.val);
+
+	return 0;
+}
+
+int
+dec_get(NumDec *res, const Num *num)
+{
+	/* Integers and decimals of any scale, taken to the current scale */
+	switch (num->type) {
+	case NUM_INT:
+		return dec_rescale(res, num->v.i, 0, dec_scale);
+	case NUM_DEC:
+		return dec_rescale(res, num->v.dec.val, num->v.dec.scale,
+		                   dec_scale);
+	default:
+		return -1;
+	}
+}
+
+void
+dec_set(Num *res, NumDec val)
+{
+	res->type = NUM_DEC;
+	res->v.dec.val = val;
+	res->v.dec.scale = dec_scale;
+	res->d = (double)val / (double)dec_pow10(dec_scale);
+}
+
+char *
+dec_fmt(char *buf, const Num *num)
+{
+	int i, scale;
+	char tmp[DEC_STR_SIZE], *ptr;
+	DecU mag;
+
+	scale = num->v.dec.scale;
+	mag = (num->v.dec.val < 0) ? -(DecU)num->v.dec.val
+	                           : (DecU)num->v.dec.val;
+
+	/* Digits are written backwards, then copied in order. */
+	ptr = tmp;
+	for (i = 0; mag > 0 || i <= scale; ++i) {
+		if (i == scale && scale > 0)
+			*ptr++ = '.';
+		*ptr++ = '0' + (int)(mag % 10);
+		mag /= 10;
+	}
+	if (num->v.dec.val < 0)
+		*ptr++ = '-';
+
+	for (i = 0; ptr > tmp; ++i)
+		buf[i] = *--ptr;
+	buf[i] = '\0';
+
+	return buf;
+}
+
+int
+dec_add(NumDec *res, const NumDec *args)
+{
+	DecU sum;
+
+	sum = (DecU)args[0] + (DecU)args[1];
+
+	/* Overflow if both operands have the same sign and the sum doesn't */
+	if ((args[0] < 0) == (args[1] < 0) && ((NumDec)sum < 0) != (args[0] < 0))
+		return -1;
+
+	*res = (NumDec)sum;
+
+	return 0;
+}
+
+int
+dec_subst(NumDec *res, const NumDec *args)
+{
+	DecU diff;
+
+	diff = (DecU)args[0] - (DecU)args[1];
+	if ((args[0] < 0) != (args[1] < 0) && ((NumDec)diff < 0) != (args[0] < 0))
+		return -1;
+
+	*res = (NumDec)diff;
+
+	return 0;
+}
+
+int
+dec_mult(NumDec *res, const NumDec *args)
+{
+	int neg;
+	DecH prod[4];
+	DecU p, q, d, r;
+
+	neg = (args[0] < 0) != (args[1] < 0);
+	p = (args[0] < 0) ? -(DecU)args[0] : (DecU)args[0];
+	q = (args[1] < 0) ? -(DecU)args[1] : (DecU)args[1];
+
+	/* p * q / 10^scale, rounded, with a wide intermediate product */
+	dec_mul_wide(prod, p, q);
+	d = dec_pow10(dec_scale);
+	if (((DecU)prod[3] << DEC_H_BITS | prod[2]) >= d)
+		return -1;
+
+	q = dec_div_wide(prod, d, &r);
+	if (dec_round(&q, r, d) < 0)
+		return -1;
+
+	return dec_pack(res, q, neg);
+}
+
+int
+dec_div(NumDec *res, const NumDec *args)
+{
+	int neg;
+	DecH num[4];
+	DecU p, q, d, r;
+
+	if (args[1] == 0)
+		return -1;
+
+	neg = (args[0] < 0) != (args[1] < 0);
+	p = (args[0] < 0) ? -(DecU)args[0] : (DecU)args[0];
+	d = (args[1] < 0) ? -(DecU)args[1] : (DecU)args[1];
+
+	/* p * 10^scale / d, rounded */
+	dec_mul_wide(num, p, dec_pow10(dec_scale));
+	if (((DecU)num[3] << DEC_H_BITS | num[2]) >= d)
+		return -1;
+
+	q = dec_div_wide(num, d, &r);
+	if (dec_round(&q, r, d) < 0)
+		return -1;
+
+	return dec_pack(res, q, neg);
+}
+
+int
+dec_prcnt(NumDec *res, const NumDec *args)
+{
+	NumDec div_args[2];
+
+	div_args[0] = args[0];
+	div_args[1] = 100 * (NumDec)dec_pow10(dec_scale);
+
+	return dec_div(res, div_args);
+}
@@ -0,0 +1,17 @@
+/* See LICENSE file for copyright and license details. */
+
+#define DEC_SCALE_MAX 18
+#define DEC_STR_SIZE 48
+
+int dec_parse(Num *res, const char *str);
+int dec_get(NumDec *res, const Num *num);
+void dec_set(Num *res, NumDec val);
+char *dec_fmt(char *buf, const Num *num);
+
+int dec_add(NumDec *res, const NumDec *args);
+int dec_subst(NumDec *res, const NumDec *args);
+int dec_mult(NumDec *res, const NumDec *args);
+int dec_div(NumDec *res, const NumDec *args);
+int dec_prcnt(NumDec *res, const NumDec *args);
+
+extern int dec_scale;
@@ -0,0 +1,354 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h> /* Dependency for num.h, op.h */
+#include <string.h>
+
+#include "num.h" /* Dependency for stack.h, mem.h, utils.h */
+#include "stack.h" /* Dependency for mem.h, op.h, prog.h */
+#include "op.h" /* Dependency for prog.h */
+#include "prog.h" /* Dependency for fn.h, mem.h */
+#include "stat.h" /* Dependency for fn.h */
+#include "fn.h"
+#include "mem.h"
+#include "par.h"
+#include "rng.h"
+#include "utils.h"
+
+#define FN_INTEG_PIECES 64 /* Independent of threads, for reproducibility */
+#define FN_INTEG_DEPTH 40
+#define FN_INTEG_EVALS 1000000 /* For each piece */
+#define FN_INTEG_ABS_TOL 1e-12
+#define FN_INTEG_REL_TOL 1e-10
+#define FN_ROOT_ITER 200
+
+typedef struct {
+	const Prog *prog;
+	Num regs[MEM_SIZE];
+	double a, h;
+	double res[FN_INTEG_PIECES];
+	long evals[PAR_THREADS_MAX];
+	int errs[PAR_THREADS_MAX];
+} FnInteg;
+
+typedef struct {
+	const Prog *prog;
+	Num regs[MEM_SIZE];
+	Rng rngs[PAR_THREADS_MAX];
+	StatAcc accs[PAR_THREADS_MAX];
+	int errs[PAR_THREADS_MAX];
+} FnMc;
+
+static double fn_gk15(Fn *fn, double a, double b, double *abserr);
+static double fn_adapt(Fn *fn, double a, double b, double tol, int depth,
+                       long cap);
+static void fn_integ_worker(void *ctx, long lo, long hi, int id);
+static void fn_mc_worker(void *ctx, long lo, long hi, int id);
+
+/* Gauss-Kronrod 7-15 nodes and weights, as in QUADPACK's qk15 */
+static const double xgk[8] = {
+	0.991455371120812639206854697526329,
+	0.949107912342758524526189684047851,
+	0.864864423359769072789712788640926,
+	0.741531185599394439863864773280788,
+	0.586087235467691130294144845693013,
+	0.405845151377397166906606412076961,
+	0.207784955007898467600689403773245,
+	0.000000000000000000000000000000000
+};
+static const double wgk[8] = {
+	0.022935322010529224963732008058970,
+	0.063092092629978553290700663189204,
+	0.104790010322250183839876322541518,
+	0.140653259715525918745189590510238,
+	0.169004726639267902826583426598550,
+	0.190350578064785409913256402421014,
+	0.204432940075298892414161999234649,
+	0.209482141084727828012999174891714
+};
+static const double wg[4] = {
+	0.129484966168869693270611432679082,
+	0.279705391489276667901467771423780,
+	0.381830050505118944950369775488975,
+	0.417959183673469387755102040816327
+};
+
+static double
+fn_gk15(Fn *fn, double a, double b, double *abserr)
+{
+	int i;
+	double center, half, fc, f1, f2, res_g, res_k;
+
+	center = (a + b) / 2;
+	half = (b - a) / 2;
+
+	fc = fn_eval(fn, center);
+	res_g = fc * wg[3];
+	res_k = fc * wgk[7];
+	for (i = 0; i < 7; ++i) {
+		f1 = fn_eval(fn, center - half * xgk[i]);
+		f2 = fn_eval(fn, center + half * xgk[i]);
+		res_k += wgk[i] * (f1 + f2);
+		if (i % 2 == 1)
+			res_g += wg[i / 2] * (f1 + f2);
+	}
+
+	*abserr = fabs((res_k - res_g) * half);
+
+	return res_k * half;
+}
+
+static double
+fn_adapt(Fn *fn, double a, double b, double tol, int depth, long cap)
+{
+	double res, abserr, mid;
+
+	/* Badly behaved functions are given up on at some point. */
+	res = fn_gk15(fn, a, b, &abserr);
+	if (abserr <= tol || abserr <= FN_INTEG_REL_TOL * fabs(res)
+	    || depth >= FN_INTEG_DEPTH || fn->evals >= cap || isnan(res))
+		return res;
+
+	mid = (a + b) / 2;
+
+	return fn_adapt(fn, a, mid, tol / 2, depth + 1, cap)
+	       + fn_adapt(fn, mid, b, tol / 2, depth + 1, cap);
+}
+
+static void
+fn_integ_worker(void *ctx, long lo, long hi, int id)
+{
+	long i;
+	double a;
+	Fn fn;
+	FnInteg *in;
+
+	in = ctx;
+	fn.prog = in->prog;
+	fn.regs = in->regs;
+	fn.evals = 0;
+	fn.err = NO_ERR;
+	for (i = lo; i < hi; ++i) {
+		a = in->a + i * in->h;
+		in->res[i] = fn_adapt(&fn, a, a + in->h,
+		                      FN_INTEG_ABS_TOL / FN_INTEG_PIECES, 0,
+		                      fn.evals + FN_INTEG_EVALS);
+	}
+
+	in->evals[id] = fn.evals;
+	in->errs[id] = fn.err;
+}
+
+static void
+fn_mc_worker(void *ctx, long lo, long hi, int id)
+{
+	long i;
+	Stack st;
+	FnMc *mc;
+
+	mc = ctx;
+	rng_state = mc->rngs[id];
+	for (i = lo; i < hi; ++i) {
+		st.sp = -1;
+		if (prog_run(mc->prog, &st, mc->regs, NULL) < 0 || st.sp < 0) {
+			mc->errs[id] = (st.sp < 0) ? STACK_ERR_MIN : err;
+			return;
+		}
+		stat_add(&mc->accs[id], st.elems[st.sp]);
+	}
+}
+
+double
+fn_eval(Fn *fn, double x)
+{
+	Stack st;
+
+	++fn->evals;
+
+	st.sp = 0;
+	st.elems[0] = x;
+	st.type[0] = NUM_DBL;
+	if (prog_run(fn->prog, &st, fn->regs, NULL) < 0 || st.sp < 0) {
+		if (fn->err == NO_ERR)
+			fn->err = (st.sp < 0) ? STACK_ERR_MIN : err;
+		return NAN;
+	}
+
+	return st.elems[st.sp];
+}
+
+int
+fn_integ(double *res, const Prog *prog, double a, double b, long *evals)
+{
+	int i;
+	static FnInteg in;
+
+	/* 
+	 * [a, b] is split into a fixed number of pieces, integrated
+	 * adaptively and in parallel, and added up in order.
+	 */
+	in.prog = prog;
+	mem_copy(in.regs);
+	in.a = a;
+	in.h = (b - a) / FN_INTEG_PIECES;
+	memset(in.evals, 0, sizeof(in.evals));
+	memset(in.errs, NO_ERR, sizeof(in.errs));
+	par_for(FN_INTEG_PIECES, fn_integ_worker, &in);
+
+	*res = 0;
+	for (i = 0; i < FN_INTEG_PIECES; ++i)
+		*res += in.res[i];
+
+	*evals = 0;
+	for (i = 0; i < PAR_THREADS_MAX; ++i)
+		*evals += in.evals[i];
+
+	for (i = 0; i < PAR_THREADS_MAX; ++i) {
+		if (in.errs[i] != NO_ERR) {
+			err = in.errs[i];
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int
+fn_mc(StatAcc *res, const Prog *prog, long n)
+{
+	int i, nthr;
+	Rng saved;
+	static FnMc mc;
+
+	/*
+	 * Each thread runs its share of the n runs with its own stream, and
+	 * their accumulators are merged in order, so that results only
+	 * depend on the seed and the number of threads.
+	 */
+	mc.prog = prog;
+	mem_copy(mc.regs);
+	rng_split(mc.rngs, PAR_THREADS_MAX);
+	for (i = 0; i < PAR_THREADS_MAX; ++i)
+		stat_clr(&mc.accs[i]);
+	memset(mc.errs, NO_ERR, sizeof(mc.errs));
+
+	/* The calling thread takes a stream too, so its own is kept aside. */
+	saved = rng_state;
+	nthr = par_for(n, fn_mc_worker, &mc);
+	rng_state = saved;
+
+	stat_clr(res);
+	for (i = 0; i < nthr; ++i)
+		stat_merge(res, &mc.accs[i]);
+
+	for (i = 0; i < nthr; ++i) {
+		if (mc.errs[i] != NO_ERR) {
+			err = mc.errs[i];
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int
+fn_root(double *res, const Prog *prog, double a, double b, long *evals)
+{
+	int i;
+	double c, d, e, fa, fb, fc, m, p, q, r, s, tol;
+	Num regs[MEM_SIZE];
+	Fn fn;
+
+	mem_copy(regs);
+	fn.prog = prog;
+	fn.regs = regs;
+	fn.evals = 0;
+	fn.err = NO_ERR;
+
+	fa = fn_eval(&fn, a);
+	fb = fn_eval(&fn, b);
+	*evals = fn.evals;
+	if (fn.err != NO_ERR) {
+		err = fn.err;
+		return -1;
+	}
+
+	/* The root must be bracketed by [a, b] */
+	if ((fa > 0 && fb > 0) || (fa < 0 && fb < 0)) {
+		err = CMD_ERR_BAD_ARGS;
+		return -1;
+	}
+
+	/* Brent's method, after his zero() procedure. */
+	c = a;
+	fc = fa;
+	d = e = b - a;
+	for (i = 0; i < FN_ROOT_ITER; ++i) {
+		if ((fb > 0 && fc > 0) || (fb < 0 && fc < 0)) {
+			c = a;
+			fc = fa;
+			d = e = b - a;
+		}
+
+		if (fabs(fc) < fabs(fb)) {
+			a = b;
+			b = c;
+			c = a;
+			fa = fb;
+			fb = fc;
+			fc = fa;
+		}
+
+		tol = 2 * DBL_EPSILON * fabs(b) + DBL_MIN;
+		m = (c - b) / 2;
+		if (fabs(m) <= tol || fb == 0)
+			break;
+
+		if (fabs(e) < tol || fabs(fa) <= fabs(fb)) {
+			d = e = m; /* Bisection */
+		} else {
+			s = fb / fa;
+			if (a == c) { /* Secant */
+				p = 2 * m * s;
+				q = 1 - s;
+			} else { /* Inverse quadratic interpolation */
+				q = fa / fc;
+				r = fb / fc;
+				p = s * (2 * m * q * (q - r) - (b - a) * (r - 1));
+				q = (q - 1) * (r - 1) * (s - 1);
+			}
+
+			if (p > 0)
+				q = -q;
+			else
+				p = -p;
+
+			if (2 * p < 3 * m * q - fabs(tol * q)
+			    && p < fabs(e * q / 2)) {
+				e = d;
+				d = p / q;
+			} else {
+				d = e = m;
+			}
+		}
+
+		a = b;
+		fa = fb;
+		if (fabs(d) > tol)
+			b += d;
+		else
+			b += (m > 0) ? tol : -tol;
+		fb = fn_eval(&fn, b);
+	}
+
+	*evals = fn.evals;
+	if (fn.err != NO_ERR) {
+		err = fn.err;
+		return -1;
+	}
+
+	*res = b;
+
+	return 0;
+}
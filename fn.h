@@ -0,0 +1,14 @@
+/* See LICENSE file for copyright and license details. */
+
+/* A compiled program used as a function of the value pushed before it */
+typedef struct {
+	const Prog *prog;
+	const Num *regs;
+	long evals;
+	int err;
+} Fn;
+
+double fn_eval(Fn *fn, double x);
+int fn_integ(double *res, const Prog *prog, double a, double b, long *evals);
+int fn_mc(StatAcc *res, const Prog *prog, long n);
+int fn_root(double *res, const Prog *prog, double a, double b, long *evals);
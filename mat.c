@@ -0,0 +1,242 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mat.h"
+#include "vec.h"
+
+#define MAT_BLOCK 64 /* Block side for mat_mul(), in elements */
+
+static int mat_lu(double *a, int n, int *perm);
+
+static Mat *mats;
+static pthread_mutex_t mats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+mat_lu(double *a, int n, int *perm)
+{
+	int i, j, k, piv, sign;
+	double l, tmp, *row_i, *row_k;
+
+	/* 
+	 * In-place LU decomposition with partial pivoting. Returns the sign
+	 * of the permutation, or 0 if the matrix is singular.
+	 */
+	sign = 1;
+	for (i = 0; i < n; ++i)
+		perm[i] = i;
+
+	for (k = 0; k < n; ++k) {
+		piv = k;
+		for (i = k + 1; i < n; ++i) {
+			if (fabs(a[i * n + k]) > fabs(a[piv * n + k]))
+				piv = i;
+		}
+
+		if (a[piv * n + k] == 0)
+			return 0;
+
+		if (piv != k) {
+			for (j = 0; j < n; ++j) {
+				tmp = a[k * n + j];
+				a[k * n + j] = a[piv * n + j];
+				a[piv * n + j] = tmp;
+			}
+			i = perm[k];
+			perm[k] = perm[piv];
+			perm[piv] = i;
+			sign = -sign;
+		}
+
+		row_k = &a[k * n];
+		for (i = k + 1; i < n; ++i) {
+			row_i = &a[i * n];
+			l = row_i[k] /= row_k[k];
+			for (j = k + 1; j < n; ++j)
+				row_i[j] -= l * row_k[j];
+		}
+	}
+
+	return sign;
+}
+
+Mat *
+mat_new(int rows, int cols)
+{
+	Mat *m;
+
+	if (rows < 1 || cols < 1 || rows > MAT_DIM_MAX || cols > MAT_DIM_MAX)
+		return NULL;
+
+	m = malloc(sizeof(Mat) + (size_t)rows * cols * sizeof(double));
+	if (m == NULL)
+		return NULL;
+
+	m->mark = 0;
+	m->rows = rows;
+	m->cols = cols;
+
+	/* Threads may create matrices while evaluating programs. */
+	pthread_mutex_lock(&mats_lock);
+	m->next = mats;
+	mats = m;
+	pthread_mutex_unlock(&mats_lock);
+
+	return m;
+}
+
+void
+mat_mark(Mat *m)
+{
+	m->mark = 1;
+}
+
+void
+mat_sweep(void)
+{
+	Mat **ptr, *m;
+
+	/* 
+	 * Frees every matrix not marked since the last sweep. Callers must
+	 * mark all matrices still reachable, and no program may be running.
+	 */
+	ptr = &mats;
+	while ((m = *ptr) != NULL) {
+		if (m->mark == 0) {
+			*ptr = m->next;
+			free(m);
+		} else {
+			m->mark = 0;
+			ptr = &m->next;
+		}
+	}
+}
+
+void
+mat_mul(Mat *c, const Mat *a, const Mat *b)
+{
+	int ii, jj, kk, i_n, j_n, k_n;
+
+	/*
+	 * Blocked product, so that blocks stay in cache, with each pair of
+	 * blocks multiplied by vec_mul_block()'s vector kernel.
+	 */
+	memset(c->a, 0, (size_t)c->rows * c->cols * sizeof(double));
+	for (ii = 0; ii < a->rows; ii += MAT_BLOCK) {
+		i_n = (ii + MAT_BLOCK < a->rows) ? MAT_BLOCK : a->rows - ii;
+		for (kk = 0; kk < a->cols; kk += MAT_BLOCK) {
+			k_n = (kk + MAT_BLOCK < a->cols) ? MAT_BLOCK : a->cols - kk;
+			for (jj = 0; jj < b->cols; jj += MAT_BLOCK) {
+				j_n = (jj + MAT_BLOCK < b->cols) ? MAT_BLOCK
+				                                 : b->cols - jj;
+				vec_mul_block(&c->a[ii * c->cols + jj], c->cols,
+				              &a->a[ii * a->cols + kk], a->cols,
+				              &b->a[kk * b->cols + jj], b->cols,
+				              i_n, k_n, j_n);
+			}
+		}
+	}
+}
+
+void
+mat_trans(Mat *t, const Mat *a)
+{
+	int i, j, ii, jj, i_end, j_end;
+
+	for (ii = 0; ii < a->rows; ii += MAT_BLOCK) {
+		i_end = (ii + MAT_BLOCK < a->rows) ? ii + MAT_BLOCK : a->rows;
+		for (jj = 0; jj < a->cols; jj += MAT_BLOCK) {
+			j_end = (jj + MAT_BLOCK < a->cols) ? jj + MAT_BLOCK
+			                                   : a->cols;
+			for (i = ii; i < i_end; ++i) {
+				for (j = jj; j < j_end; ++j)
+					t->a[j * t->cols + i] = a->a[i * a->cols + j];
+			}
+		}
+	}
+}
+
+/* Returns -1 if a is singular, and -2 if out of memory */
+int
+mat_solve(Mat *x, const Mat *a, const Mat *b)
+{
+	int i, j, k, n, m, *perm, res;
+	double l, *lu, *x_row;
+
+	n = a->rows;
+	m = b->cols;
+	lu = malloc((size_t)n * n * sizeof(double));
+	perm = malloc((size_t)n * sizeof(int));
+	res = -2;
+	if (lu == NULL || perm == NULL)
+		goto fail;
+
+	memcpy(lu, a->a, (size_t)n * n * sizeof(double));
+	res = -1;
+	if (mat_lu(lu, n, perm) == 0)
+		goto fail;
+
+	for (i = 0; i < n; ++i)
+		memcpy(&x->a[i * m], &b->a[perm[i] * m], m * sizeof(double));
+
+	/* Forward substitution with L (unit diagonal), then back with U */
+	for (i = 0; i < n; ++i) {
+		x_row = &x->a[i * m];
+		for (k = 0; k < i; ++k) {
+			l = lu[i * n + k];
+			for (j = 0; j < m; ++j)
+				x_row[j] -= l * x->a[k * m + j];
+		}
+	}
+
+	for (i = n - 1; i >= 0; --i) {
+		x_row = &x->a[i * m];
+		for (k = i + 1; k < n; ++k) {
+			l = lu[i * n + k];
+			for (j = 0; j < m; ++j)
+				x_row[j] -= l * x->a[k * m + j];
+		}
+		for (j = 0; j < m; ++j)
+			x_row[j] /= lu[i * n + i];
+	}
+
+	free(lu);
+	free(perm);
+
+	return 0;
+
+fail:
+	free(lu);
+	free(perm);
+
+	return res;
+}
+
+double
+mat_det(const Mat *a)
+{
+	int i, n, sign, *perm;
+	double det, *lu;
+
+	n = a->rows;
+	lu = malloc((size_t)n * n * sizeof(double));
+	perm = malloc((size_t)n * sizeof(int));
+	if (lu == NULL || perm == NULL) {
+		det = NAN;
+		goto end;
+	}
+
+	memcpy(lu, a->a, (size_t)n * n * sizeof(double));
+	det = sign = mat_lu(lu, n, perm);
+	for (i = 0; i < n && sign != 0; ++i)
+		det *= lu[i * n + i];
+
+end:
+	free(lu);
+	free(perm);
+
+	return det;
+}
@@ -0,0 +1,21 @@
+/* See LICENSE file for copyright and license details. */
+
+#define MAT_DIM_MAX 4096
+
+struct Mat {
+	struct Mat *next; /* All matrices are chained for the collector */
+	int mark;
+	int rows, cols;
+	double a[]; /* Row-major */
+};
+
+typedef struct Mat Mat;
+
+Mat *mat_new(int rows, int cols);
+void mat_mark(Mat *m);
+void mat_sweep(void);
+
+void mat_mul(Mat *c, const Mat *a, const Mat *b);
+void mat_trans(Mat *t, const Mat *a);
+int mat_solve(Mat *x, const Mat *a, const Mat *b);
+double mat_det(const Mat *a);
@@ -1,42 +1,516 @@
 /* See LICENSE file for copyright and license details. */
 
+#include <ctype.h>
+#include <stdint.h> /* Dependency for num.h, op.h */
+#include <stdlib.h>
 #include <string.h>
 
+#include "mat.h"
+#include "num.h" /* Dependency for big.h, mem.h, stack.h */
+#include "big.h"
+#include "stack.h" /* Dependency for mem.h, op.h, prog.h */
+#include "op.h" /* Dependency for prog.h */
+#include "prog.h" /* Dependency for mem.h */
 #include "mem.h"
 #include "utils.h"
 
-static int mem_var_to_i(char var);
+#define MEM_HASH_SIZE (MEM_SIZE * 2) /* Power of 2, masked in mem_lookup() */
+#define MEM_REGS "ABCDEFGHIJ" /* Always defined, in this order */
 
-static double mem[MEM_SIZE];
+typedef struct {
+	Prog *prog; /* NULL if the register isn't bound */
+	int dirty;
+	int *users; /* Bound registers reading this one */
+	int users_n, users_size;
+} MemBind;
+
+static unsigned int mem_hash(const char *name);
+static int *mem_lookup(const char *name);
+static void mem_init(void);
+static int mem_users_add(int i, int user);
+static void mem_users_del(int i, int user);
+static int mem_reaches(int from, int to, char *seen);
+static void mem_reads(const Prog *prog, char *reads);
+static void mem_invalidate(int i);
+static void mem_deps_walk(int i, int *deps, int *n, char *seen);
+static void mem_unbind(int i);
+static int mem_eval(int i);
+
+static Num mem[MEM_SIZE];
+static MemBind binds[MEM_SIZE];
+
+/*
+ * Names are interned into slots of mem, in order, and only looked up when
+ * compiling programs or parsing commands. The hash table maps them to
+ * their slot plus one, 0 being an empty entry.
+ */
+static char names[MEM_SIZE][MEM_NAME_SIZE];
+static int names_n;
+static int table[MEM_HASH_SIZE];
+
+/* FNV-1a */
+static unsigned int
+mem_hash(const char *name)
+{
+	unsigned int h;
+
+	for (h = 2166136261u; *name != '\0'; ++name)
+		h = (h ^ (unsigned char)*name) * 16777619u;
+
+	return h;
+}
+
+/* Entry of name in table, or the empty one where it would go */
+static int *
+mem_lookup(const char *name)
+{
+	unsigned int h;
+
+	/* Linear probing; the table is never more than half full. */
+	for (h = mem_hash(name) & (MEM_HASH_SIZE - 1); table[h] != 0;
+	     h = (h + 1) & (MEM_HASH_SIZE - 1)) {
+		if (strcmp(names[table[h] - 1], name) == 0)
+			break;
+	}
+
+	return &table[h];
+}
+
+static void
+mem_init(void)
+{
+	const char *reg;
+
+	for (reg = MEM_REGS; *reg != '\0'; ++reg) {
+		names[names_n][0] = *reg;
+		*mem_lookup(names[names_n]) = names_n + 1;
+		++names_n;
+	}
+}
 
 static int
-mem_var_to_i(char var)
+mem_users_add(int i, int user)
 {
-	int i;
+	int j, *users;
+
+	for (j = 0; j < binds[i].users_n; ++j) {
+		if (binds[i].users[j] == user)
+			return 0;
+	}
 
-	i = var - 'A';
-	if (i < 0 || i >= MEM_SIZE) {
+	if (binds[i].users_n == binds[i].users_size) {
+		users = realloc(binds[i].users,
+		                (binds[i].users_size + MEM_SIZE) * sizeof(int));
+		if (users == NULL) {
+			err = MEM_ERR_ALLOC;
+			return -1;
+		}
+		binds[i].users = users;
+		binds[i].users_size += MEM_SIZE;
+	}
+
+	binds[i].users[binds[i].users_n++] = user;
+
+	return 0;
+}
+
+static void
+mem_users_del(int i, int user)
+{
+	int j;
+
+	for (j = 0; j < binds[i].users_n; ++j) {
+		if (binds[i].users[j] == user) {
+			binds[i].users[j] = binds[i].users[--binds[i].users_n];
+			return;
+		}
+	}
+}
+
+static int
+mem_reaches(int from, int to, char *seen)
+{
+	const ProgIns *ins;
+	const Prog *prog;
+
+	if (from == to)
+		return 1;
+
+	if (seen[from] != 0 || (prog = binds[from].prog) == NULL)
+		return 0;
+
+	seen[from] = 1;
+	for (ins = prog->ins; ins < prog->ins + prog->n; ++ins) {
+		if (ins->type == PROG_REG
+		    && mem_reaches(ins->arg.reg, to, seen) != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Sets reads[j] for every register j read by prog, if any */
+static void
+mem_reads(const Prog *prog, char *reads)
+{
+	const ProgIns *ins;
+
+	if (prog == NULL)
+		return;
+
+	for (ins = prog->ins; ins < prog->ins + prog->n; ++ins) {
+		if (ins->type == PROG_REG)
+			reads[ins->arg.reg] = 1;
+	}
+}
+
+static void
+mem_invalidate(int i)
+{
+	int j, user;
+
+	/* 
+	 * Users of a dirty binding are always dirty themselves, so we only
+	 * walk the part of the graph that actually changes state.
+	 */
+	for (j = 0; j < binds[i].users_n; ++j) {
+		user = binds[i].users[j];
+		if (binds[user].dirty == 0) {
+			binds[user].dirty = 1;
+			mem_invalidate(user);
+		}
+	}
+}
+
+static void
+mem_unbind(int i)
+{
+	const ProgIns *ins;
+	Prog *prog;
+
+	if ((prog = binds[i].prog) == NULL)
+		return;
+
+	for (ins = prog->ins; ins < prog->ins + prog->n; ++ins) {
+		if (ins->type == PROG_REG)
+			mem_users_del(ins->arg.reg, i);
+	}
+
+	free(prog);
+	binds[i].prog = NULL;
+	binds[i].dirty = 0;
+}
+
+static int
+mem_eval(int i)
+{
+	Stack st;
+
+	/* Registers read by the binding get recomputed first, if needed. */
+	st.sp = -1;
+	if (prog_run(binds[i].prog, &st, NULL, NULL) < 0)
+		return -1;
+
+	if (st.sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	mem[i].type = st.type[st.sp];
+	mem[i].d = st.elems[st.sp];
+	mem[i].v = st.vals[st.sp];
+	binds[i].dirty = 0;
+
+	return 0;
+}
+
+int
+mem_index(const char *name)
+{
+	int *entry;
+
+	if (names_n == 0)
+		mem_init();
+
+	if (*(entry = mem_lookup(name)) == 0) {
 		err = MEM_ERR_NOT_FOUND;
 		return -1;
 	}
 
-	return i;
+	return *entry - 1;
+}
+
+int
+mem_intern(const char *name)
+{
+	int *entry;
+	size_t i, len;
+	char *endptr;
+
+	if (names_n == 0)
+		mem_init();
+
+	if (*(entry = mem_lookup(name)) != 0)
+		return *entry - 1;
+
+	/* 
+	 * Names must read as such in programs: not as numbers, as they are
+	 * parsed first, nor as operations, which would be shadowed.
+	 */
+	len = strlen(name);
+	strtod(name, &endptr);
+	if (len == 0 || len >= MEM_NAME_SIZE || isalpha((unsigned char)name[0]) == 0
+	    || *endptr == '\0' || op_valid(op(name)) == 0) {
+		err = MEM_ERR_NAME;
+		return -1;
+	}
+
+	for (i = 1; i < len; ++i) {
+		if (isalnum((unsigned char)name[i]) == 0 && name[i] != '_') {
+			err = MEM_ERR_NAME;
+			return -1;
+		}
+	}
+
+	if (names_n == MEM_SIZE) {
+		err = MEM_ERR_FULL;
+		return -1;
+	}
+
+	memcpy(names[names_n], name, len + 1);
+	*entry = ++names_n;
+
+	return names_n - 1;
+}
+
+int
+mem_bind(int i, const char *expr)
+{
+	int j;
+	char seen[MEM_SIZE], old[MEM_SIZE];
+	const ProgIns *ins;
+	Prog *prog;
+
+	if (expr == NULL) {
+		mem_unbind(i);
+		return 0;
+	}
+
+	if ((prog = malloc(sizeof(Prog))) == NULL) {
+		err = MEM_ERR_ALLOC;
+		return -1;
+	}
+
+	if (prog_compile(prog, expr) < 0)
+		goto fail;
+
+	/* Bindings are checked in full beforehand, as nobody sees them run. */
+	for (ins = prog->ins; ins < prog->ins + prog->n; ++ins) {
+		if (ins->type == PROG_ERR) {
+			err = ins->arg.err;
+			goto fail;
+		}
+
+		memset(seen, 0, sizeof(seen));
+		if (ins->type == PROG_REG
+		    && mem_reaches(ins->arg.reg, i, seen) != 0) {
+			err = MEM_ERR_CYCLE;
+			goto fail;
+		}
+	}
+
+	/*
+	 * Users are added before the old binding goes, so that it's left as
+	 * it was on failure: only links it didn't have are rolled back.
+	 */
+	memset(old, 0, sizeof(old));
+	mem_reads(binds[i].prog, old);
+	for (ins = prog->ins; ins < prog->ins + prog->n; ++ins) {
+		if (ins->type == PROG_REG
+		    && mem_users_add(ins->arg.reg, i) < 0) {
+			for (j = 0; j < MEM_SIZE; ++j) {
+				if (old[j] == 0)
+					mem_users_del(j, i);
+			}
+			goto fail;
+		}
+	}
+
+	/* Then only links the new binding doesn't have are dropped. */
+	memset(seen, 0, sizeof(seen));
+	mem_reads(prog, seen);
+	for (j = 0; j < MEM_SIZE; ++j) {
+		if (old[j] != 0 && seen[j] == 0)
+			mem_users_del(j, i);
+	}
+
+	free(binds[i].prog);
+	binds[i].prog = prog;
+	binds[i].dirty = 1;
+	mem_invalidate(i);
+
+	return 0;
+
+fail:
+	free(prog);
+	return -1;
 }
 
 int
 mem_clr(void)
 {
+	int i;
+
+	/* Names are kept, as compiled programs refer to their slots. */
+	for (i = 0; i < MEM_SIZE; ++i)
+		mem_unbind(i);
 	memset(mem, 0, sizeof(mem));
 
 	return 0;
 }
 
+void
+mem_copy(Num *dest)
+{
+	int i;
+
+	/* Bindings are brought up to date; failed ones keep their value. */
+	for (i = 0; i < MEM_SIZE; ++i) {
+		if (binds[i].dirty != 0)
+			mem_eval(i);
+	}
+
+	memcpy(dest, mem, sizeof(mem));
+}
+
+/* Post-order walk of the users of i, see mem_deps() */
+static void
+mem_deps_walk(int i, int *deps, int *n, char *seen)
+{
+	int j, user;
+
+	for (j = 0; j < binds[i].users_n; ++j) {
+		user = binds[i].users[j];
+		if (seen[user] == 0) {
+			seen[user] = 1;
+			mem_deps_walk(user, deps, n, seen);
+			deps[(*n)++] = user;
+		}
+	}
+}
+
+/*
+ * Bound registers reading reg, directly or not, in an order they can be
+ * evaluated in. Returns how many there are.
+ */
+int
+mem_deps(int reg, int *deps)
+{
+	int i, n, tmp;
+	char seen[MEM_SIZE];
+
+	memset(seen, 0, sizeof(seen));
+	seen[reg] = 1;
+	n = 0;
+	mem_deps_walk(reg, deps, &n, seen);
+
+	/* Users come before what they read in post-order. */
+	for (i = 0; i < n / 2; ++i) {
+		tmp = deps[i];
+		deps[i] = deps[n - 1 - i];
+		deps[n - 1 - i] = tmp;
+	}
+
+	return n;
+}
+
+/*
+ * Evaluates the n bindings in deps, as given by mem_deps(), against the
+ * private registers regs, so that they follow a register changed there.
+ */
 int
-mem_get(double *val, char var)
+mem_follow(Num *regs, const int *deps, int n)
 {
 	int i;
+	Stack st;
+
+	for (i = 0; i < n; ++i) {
+		st.sp = -1;
+		if (prog_run(binds[deps[i]].prog, &st, regs, NULL) < 0)
+			return -1;
+
+		if (st.sp < 0) {
+			err = STACK_ERR_MIN;
+			return -1;
+		}
+
+		regs[deps[i]].type = st.type[st.sp];
+		regs[deps[i]].d = st.elems[st.sp];
+		regs[deps[i]].v = st.vals[st.sp];
+	}
+
+	return 0;
+}
+
+void
+mem_collect(const Stack *keep, const Prog *prog)
+{
+	int i, j;
+	const Stack *sts[2];
+
+	/*
+	 * Matrices and big integers not held by registers, the stack, the
+	 * optional keep stack or the constants of the optional program prog,
+	 * as folded by prog_opt(), are freed. No other program may be running.
+	 */
+	for (i = 0; i < MEM_SIZE; ++i) {
+		if (mem[i].type == NUM_MAT)
+			mat_mark(mem[i].v.m);
+		else if (mem[i].type == NUM_BIG)
+			big_mark(mem[i].v.b);
+	}
 
-	if ((i = mem_var_to_i(var)) < 0)
+	sts[0] = &stack;
+	sts[1] = keep;
+	for (i = 0; i < 2 && sts[i] != NULL; ++i) {
+		for (j = 0; j <= sts[i]->sp; ++j) {
+			if (sts[i]->type[j] == NUM_MAT)
+				mat_mark(sts[i]->vals[j].m);
+			else if (sts[i]->type[j] == NUM_BIG)
+				big_mark(sts[i]->vals[j].b);
+		}
+	}
+
+	for (i = 0; prog != NULL && i < prog->n; ++i) {
+		if (prog->ins[i].type != PROG_NUM)
+			continue;
+		if (prog->ins[i].arg.num.type == NUM_MAT)
+			mat_mark(prog->ins[i].arg.num.v.m);
+		else if (prog->ins[i].arg.num.type == NUM_BIG)
+			big_mark(prog->ins[i].arg.num.v.b);
+	}
+
+	mat_sweep();
+	big_sweep();
+}
+
+int
+mem_get(double *val, int i)
+{
+	Num num;
+
+	if (mem_get_num(&num, i) < 0)
+		return -1;
+
+	*val = num.d;
+
+	return 0;
+}
+
+int
+mem_get_num(Num *val, int i)
+{
+	if (binds[i].dirty != 0 && mem_eval(i) < 0)
 		return -1;
 
 	*val = mem[i];
@@ -45,14 +519,31 @@ mem_get(double *val, char var)
 }
 
 int
-mem_set(char var, double val)
+mem_set(int i, double val)
 {
-	int i;
+	Num num;
 
-	if ((i = mem_var_to_i(var)) < 0)
-		return -1;
+	memset(&num, 0, sizeof(num));
+	num.type = NUM_DBL;
+	num.d = val;
+
+	return mem_set_num(i, &num);
+}
 
-	mem[i] = val;
+int
+mem_set_num(int i, const Num *val)
+{
+	/* Setting a bound register replaces its binding. */
+	mem_unbind(i);
+	mem[i] = *val;
+	mem_invalidate(i);
 
 	return 0;
 }
+
+const Prog *
+mem_prog(int i)
+{
+	/* NULL if the register isn't bound */
+	return binds[i].prog;
+}
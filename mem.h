@@ -1,7 +1,18 @@
 /* See LICENSE file for copyright and license details. */
 
-#define MEM_SIZE 10
+#define MEM_SIZE 256 /* Variables, including registers A-J; power of 2 */
+#define MEM_NAME_SIZE 16
 
+int mem_bind(int i, const char *expr);
 int mem_clr(void);
-int mem_get(double *val, char var);
-int mem_set(char var, double val);
+void mem_copy(Num *dest);
+int mem_deps(int reg, int *deps);
+int mem_follow(Num *regs, const int *deps, int n);
+int mem_index(const char *name);
+int mem_intern(const char *name);
+void mem_collect(const Stack *keep, const Prog *prog);
+int mem_get(double *val, int i);
+int mem_get_num(Num *val, int i);
+int mem_set(int i, double val);
+int mem_set_num(int i, const Num *val);
+const Prog *mem_prog(int i);
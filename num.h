@@ -0,0 +1,43 @@
+/* See LICENSE file for copyright and license details. */
+
+enum {
+	NUM_DBL,
+	NUM_INT,
+	NUM_DEC,
+	NUM_MAT,
+	NUM_BIG
+};
+
+struct Big;
+struct Mat;
+
+/* 
+ * Decimals are integers scaled by 10^scale, see dec.c. Compilers without
+ * a 128-bit integer type get 64-bit decimals, with fewer digits.
+ */
+#ifdef __SIZEOF_INT128__
+__extension__ typedef __int128 NumDec;
+#else
+typedef int64_t NumDec;
+#endif
+
+typedef union {
+	int64_t i;
+	struct {
+		NumDec val;
+		int scale;
+	} dec;
+	struct Mat *m;
+	struct Big *b;
+} NumVal;
+
+/*
+ * d always holds the value as a double, so that any operation without a
+ * typed path can fall back to it (NaN for matrices, an approximation for
+ * big integers). v is only meaningful for typed values.
+ */
+typedef struct {
+	int type;
+	double d;
+	NumVal v;
+} Num;
@@ -4,8 +4,17 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "num.h" /* Dependency for big.h, dec.h, stack.h, utils.h */
+#include "big.h"
+#include "dec.h"
+#include "mat.h"
+#include "stack.h" /* Dependency for op.h */
 #include "op.h"
+#include "plugin.h"
+#include "rng.h"
+#include "stat.h"
 #include "utils.h"
+#include "vec.h"
 
 #define OP_E 2.71828182845904523536
 #define OP_PI 3.14159265358979323846
@@ -17,9 +26,30 @@ static double op_div(double p, double q);
 static double op_prcnt(double n);
 static double op_mod(double p, double q);
 static double op_fact(double n);
+static int op_add_i(int64_t *res, const int64_t *args);
+static int op_subst_i(int64_t *res, const int64_t *args);
+static int op_mult_i(int64_t *res, const int64_t *args);
+static int op_mod_i(int64_t *res, const int64_t *args);
+static int op_fact_i(int64_t *res, const int64_t *args);
+
+/* Typed paths */
+static int op_typed(Num *res, const Num *args, int n,
+                    int (*ifunc)(int64_t *, const int64_t *),
+                    int (*bfunc)(Num *, const Num *),
+                    int (*dfunc)(NumDec *, const NumDec *));
+static int op_add_t(Num *res, const Num *args);
+static int op_subst_t(Num *res, const Num *args);
+static int op_mult_t(Num *res, const Num *args);
+static int op_div_t(Num *res, const Num *args);
+static int op_prcnt_t(Num *res, const Num *args);
+static int op_mod_t(Num *res, const Num *args);
+static int op_fact_t(Num *res, const Num *args);
 static double op_npr(double n, double r);
+static int op_npr_t(Num *res, const Num *args);
 static double op_ncr(double n, double r);
+static int op_ncr_t(Num *res, const Num *args);
 static double op_tan(double n);
+static void op_tan_v(double *res, const double *x, int n);
 static double op_cot(double n);
 static double op_sec(double n);
 static double op_csc(double n);
@@ -29,41 +59,200 @@ static double op_acsc(double n);
 static double op_todeg(double n);
 static double op_torad(double n);
 
+/* Derivatives, see prog_grad() */
+static void op_add_d(double *d, double p, double q);
+static void op_subst_d(double *d, double p, double q);
+static void op_mult_d(double *d, double p, double q);
+static void op_div_d(double *d, double p, double q);
+static void op_pow_d(double *d, double p, double q);
+static double op_prcnt_d(double n);
+static double op_abs_d(double n);
+static double op_ln_d(double n);
+static double op_sqrt_d(double n);
+static void op_mod_d(double *d, double p, double q);
+static double op_fact_s(double n);
+static double op_fact_d(double n);
+static void op_npr_d(double *d, double n, double r);
+static void op_ncr_d(double *d, double n, double r);
+static double op_cos_d(double n);
+static double op_tan_d(double n);
+static double op_cot_d(double n);
+static double op_sec_d(double n);
+static double op_csc_d(double n);
+static double op_asin_d(double n);
+static double op_acos_d(double n);
+static double op_atan_d(double n);
+static double op_acot_d(double n);
+static double op_asec_d(double n);
+static double op_acsc_d(double n);
+static double op_todeg_d(double n);
+static double op_torad_d(double n);
+
+/* Whole stack */
+static int op_stk_check(const Stack *st, int min);
+static int op_stk_set(Stack *st, double res);
+static int op_stk_typed(const Stack *st);
+static int op_stk_fold(Stack *st, int (*tfunc)(Num *, const Num *),
+                       double (*func)(double, double));
+static int op_stk_sum(Stack *st);
+static int op_stk_ksum(Stack *st);
+static int op_stk_prod(Stack *st);
+static int op_stk_min(Stack *st);
+static int op_stk_max(Stack *st);
+static int op_stk_dot(Stack *st);
+static int op_stk_apply(Stack *st, int (*tfunc)(Num *, const Num *),
+                        double (*func)(double, double),
+                        void (*vfunc)(double *, int, double));
+static int op_stk_add(Stack *st);
+static int op_stk_mult(Stack *st);
+static int op_poly(Stack *st);
+static int op_dual_sum(DualStack *st);
+static int op_dual_ksum(DualStack *st);
+static int op_dual_prod(DualStack *st);
+static int op_dual_pick(DualStack *st, double res);
+static int op_dual_min(DualStack *st);
+static int op_dual_max(DualStack *st);
+static int op_dual_dot(DualStack *st);
+static int op_dual_add(DualStack *st);
+static int op_dual_mult(DualStack *st);
+static int op_dual_poly(DualStack *st);
+
+/* Matrices */
+static Mat *op_stk_mat(Stack *st, int i);
+static int op_stk_dim(Stack *st, int i, int *dim);
+static int op_stk_set_mat(Stack *st, int n, Mat *m);
+static int op_mat_new(Stack *st);
+static int op_mat_eye(Stack *st);
+static int op_mat_mult(Stack *st);
+static int op_mat_trans(Stack *st);
+static int op_mat_solve(Stack *st);
+static int op_mat_det(Stack *st);
+
+/* Accumulators */
+static double op_acc_mean(void);
+static double op_acc_var(void);
+static double op_acc_stddev(void);
+static double op_acc_sum(void);
+static double op_acc_count(void);
+static double op_acc_min(void);
+static double op_acc_max(void);
+
 /* Constants */
 static double op_cst_e(void);
 static double op_cst_pi(void);
 
 const OpReg op_defs[] = {
-	{ "+", 2, { .n2 = op_add }, "Addition" },
-	{ "-", 2, { .n2 = op_subst }, "Substraction" },
-	{ "*", 2, { .n2 = op_mult }, "Multiplication" },
-	{ "/", 2, { .n2 = op_div }, "Division" },
-	{ "^", 2, { .n2 = pow }, "Exponent" },
-	{ "%", 1, { .n1 = op_prcnt }, "Percentage" },
-	{ "abs", 1, { .n1 = fabs }, "Absolute value" },
-	{ "ln", 1, { .n1 = log }, "Natural logarithm" },
-	{ "sqrt", 1, { .n1 = sqrt }, "Square root" },
-	{ "mod", 2, { .n2 = op_mod }, "Modulo" },
-	{ "!", 1, { .n1 = op_fact }, "Factorial" },
-	{ "nPr", 2, { .n2 = op_npr }, "Permutation operation" },
-	{ "nCr", 2, { .n2 = op_ncr }, "Binomial coefficient" },
-	{ "sin", 1, { .n1 = sin }, "Sine (in radians)" },
-	{ "cos", 1, { .n1 = cos }, "Cosine (in radians)" },
-	{ "tan", 1, { .n1 = op_tan }, "Tangent (in radians)" },
-	{ "cot", 1, { .n1 = op_cot }, "Cotangent (in radians)" },
-	{ "sec", 1, { .n1 = op_sec }, "Secant (in radians)" },
-	{ "csc", 1, { .n1 = op_csc }, "Cosecant (in radians)" },
-	{ "asin", 1, { .n1 = asin }, "Arcsine (returns radians)" },
-	{ "acos", 1, { .n1 = acos }, "Arccosine (returns radians)" },
-	{ "atan", 1, { .n1 = atan }, "Arctangent (returns radians)" },
-	{ "acot", 1, { .n1 = op_acot }, "Arccotagent (returns radians)" },
-	{ "asec", 1, { .n1 = op_asec }, "Arcsecant (returns radians)" },
-	{ "acsc", 1, { .n1 = op_acsc }, "Arccosecant (returns radians)" },
-	{ "todeg", 1, { .n1 = op_todeg }, "Convert radians to degrees" },
-	{ "torad", 1, { .n1 = op_torad }, "Convert degrees to radians" },
-	{ "e", 0, { .n0 = op_cst_e }, "The e constant" },
-	{ "pi", 0, { .n0 = op_cst_pi }, "The pi constant" },
-	{ "", -1, { .n0 = NULL }, "" } /* Dummy "terminator" entry */
+	{ "+", 2, { .n2 = op_add }, op_add_t, { NULL }, { .d2 = op_add_d },
+	  "Addition" },
+	{ "-", 2, { .n2 = op_subst }, op_subst_t, { NULL },
+	  { .d2 = op_subst_d }, "Substraction" },
+	{ "*", 2, { .n2 = op_mult }, op_mult_t, { NULL }, { .d2 = op_mult_d },
+	  "Multiplication" },
+	{ "/", 2, { .n2 = op_div }, op_div_t, { NULL }, { .d2 = op_div_d },
+	  "Division" },
+	{ "^", 2, { .n2 = pow }, NULL, { .v2 = vec_pow }, { .d2 = op_pow_d },
+	  "Exponent" },
+	{ "%", 1, { .n1 = op_prcnt }, op_prcnt_t, { NULL },
+	  { .d1 = op_prcnt_d }, "Percentage" },
+	{ "abs", 1, { .n1 = fabs }, NULL, { NULL }, { .d1 = op_abs_d },
+	  "Absolute value" },
+	{ "ln", 1, { .n1 = log }, NULL, { .v1 = vec_log }, { .d1 = op_ln_d },
+	  "Natural logarithm" },
+	{ "exp", 1, { .n1 = exp }, NULL, { .v1 = vec_exp }, { .d1 = exp },
+	  "Exponential (e to the power of)" },
+	{ "sqrt", 1, { .n1 = sqrt }, NULL, { NULL }, { .d1 = op_sqrt_d },
+	  "Square root" },
+	{ "mod", 2, { .n2 = op_mod }, op_mod_t, { NULL }, { .d2 = op_mod_d },
+	  "Modulo" },
+	{ "!", 1, { .n1 = op_fact }, op_fact_t, { NULL }, { .d1 = op_fact_d },
+	  "Factorial" },
+	{ "nPr", 2, { .n2 = op_npr }, op_npr_t, { NULL }, { .d2 = op_npr_d },
+	  "Permutation operation" },
+	{ "nCr", 2, { .n2 = op_ncr }, op_ncr_t, { NULL }, { .d2 = op_ncr_d },
+	  "Binomial coefficient" },
+	{ "sin", 1, { .n1 = sin }, NULL, { .v1 = vec_sin }, { .d1 = cos },
+	  "Sine (in radians)" },
+	{ "cos", 1, { .n1 = cos }, NULL, { .v1 = vec_cos }, { .d1 = op_cos_d },
+	  "Cosine (in radians)" },
+	{ "tan", 1, { .n1 = op_tan }, NULL, { .v1 = op_tan_v },
+	  { .d1 = op_tan_d }, "Tangent (in radians)" },
+	{ "cot", 1, { .n1 = op_cot }, NULL, { .v1 = vec_cot },
+	  { .d1 = op_cot_d }, "Cotangent (in radians)" },
+	{ "sec", 1, { .n1 = op_sec }, NULL, { .v1 = vec_sec },
+	  { .d1 = op_sec_d }, "Secant (in radians)" },
+	{ "csc", 1, { .n1 = op_csc }, NULL, { .v1 = vec_csc },
+	  { .d1 = op_csc_d }, "Cosecant (in radians)" },
+	{ "asin", 1, { .n1 = asin }, NULL, { NULL }, { .d1 = op_asin_d },
+	  "Arcsine (returns radians)" },
+	{ "acos", 1, { .n1 = acos }, NULL, { NULL }, { .d1 = op_acos_d },
+	  "Arccosine (returns radians)" },
+	{ "atan", 1, { .n1 = atan }, NULL, { NULL }, { .d1 = op_atan_d },
+	  "Arctangent (returns radians)" },
+	{ "acot", 1, { .n1 = op_acot }, NULL, { NULL }, { .d1 = op_acot_d },
+	  "Arccotagent (returns radians)" },
+	{ "asec", 1, { .n1 = op_asec }, NULL, { NULL }, { .d1 = op_asec_d },
+	  "Arcsecant (returns radians)" },
+	{ "acsc", 1, { .n1 = op_acsc }, NULL, { NULL }, { .d1 = op_acsc_d },
+	  "Arccosecant (returns radians)" },
+	{ "todeg", 1, { .n1 = op_todeg }, NULL, { NULL }, { .d1 = op_todeg_d },
+	  "Convert radians to degrees" },
+	{ "torad", 1, { .n1 = op_torad }, NULL, { NULL }, { .d1 = op_torad_d },
+	  "Convert degrees to radians" },
+	{ "ssum", OP_ARGS_STACK, { .ns = op_stk_sum }, NULL, { NULL },
+	  { .ds = op_dual_sum }, "Sum of the whole stack (pairwise)" },
+	{ "ksum", OP_ARGS_STACK, { .ns = op_stk_ksum }, NULL, { NULL },
+	  { .ds = op_dual_ksum }, "Sum of the whole stack (compensated)" },
+	{ "sprod", OP_ARGS_STACK, { .ns = op_stk_prod }, NULL, { NULL },
+	  { .ds = op_dual_prod }, "Product of the whole stack" },
+	{ "smin", OP_ARGS_STACK, { .ns = op_stk_min }, NULL, { NULL },
+	  { .ds = op_dual_min }, "Minimum of the whole stack" },
+	{ "smax", OP_ARGS_STACK, { .ns = op_stk_max }, NULL, { NULL },
+	  { .ds = op_dual_max }, "Maximum of the whole stack" },
+	{ "dot", OP_ARGS_STACK, { .ns = op_stk_dot }, NULL, { NULL },
+	  { .ds = op_dual_dot }, "Dot product of both halves of the stack" },
+	{ "sadd", OP_ARGS_STACK, { .ns = op_stk_add }, NULL, { NULL },
+	  { .ds = op_dual_add }, "Add last element to the rest of the stack" },
+	{ "smul", OP_ARGS_STACK, { .ns = op_stk_mult }, NULL, { NULL },
+	  { .ds = op_dual_mult },
+	  "Multiply the rest of the stack by last element" },
+	{ "poly", OP_ARGS_STACK, { .ns = op_poly }, NULL, { NULL },
+	  { .ds = op_dual_poly },
+	  "Polynomial (x, coefficients from highest, degree)" },
+	{ "mat", OP_ARGS_STACK, { .ns = op_mat_new }, NULL, { NULL }, { NULL },
+	  "Matrix from stack elements, rows and columns" },
+	{ "eye", OP_ARGS_STACK, { .ns = op_mat_eye }, NULL, { NULL }, { NULL },
+	  "Identity matrix" },
+	{ "mmul", OP_ARGS_STACK, { .ns = op_mat_mult }, NULL, { NULL },
+	  { NULL }, "Matrix multiplication" },
+	{ "mt", OP_ARGS_STACK, { .ns = op_mat_trans }, NULL, { NULL }, { NULL },
+	  "Matrix transpose" },
+	{ "solve", OP_ARGS_STACK, { .ns = op_mat_solve }, NULL, { NULL },
+	  { NULL }, "Solve linear system (A B -> X so that AX = B)" },
+	{ "det", OP_ARGS_STACK, { .ns = op_mat_det }, NULL, { NULL }, { NULL },
+	  "Matrix determinant" },
+	{ "mean", 0, { .n0 = op_acc_mean }, NULL, { NULL }, { NULL },
+	  "Mean of accumulated values" },
+	{ "var", 0, { .n0 = op_acc_var }, NULL, { NULL }, { NULL },
+	  "Variance of accumulated values" },
+	{ "stddev", 0, { .n0 = op_acc_stddev }, NULL, { NULL }, { NULL },
+	  "Standard deviation of accumulated values" },
+	{ "sum", 0, { .n0 = op_acc_sum }, NULL, { NULL }, { NULL },
+	  "Sum of accumulated values" },
+	{ "count", 0, { .n0 = op_acc_count }, NULL, { NULL }, { NULL },
+	  "Number of accumulated values" },
+	{ "amin", 0, { .n0 = op_acc_min }, NULL, { NULL }, { NULL },
+	  "Minimum accumulated value" },
+	{ "amax", 0, { .n0 = op_acc_max }, NULL, { NULL }, { NULL },
+	  "Maximum accumulated value" },
+	{ "e", 0, { .n0 = op_cst_e }, NULL, { NULL }, { NULL },
+	  "The e constant" },
+	{ "pi", 0, { .n0 = op_cst_pi }, NULL, { NULL }, { NULL },
+	  "The pi constant" },
+	{ "rand", 0, { .n0 = rng_unif }, NULL, { NULL }, { NULL },
+	  "Uniform random number in [0, 1)" },
+	{ "randn", 0, { .n0 = rng_norm }, NULL, { NULL }, { NULL },
+	  "Standard normal random number" },
+	{ "", -1, { .n0 = NULL }, NULL, { NULL }, { NULL }, "" } /* Dummy "terminator" entry */
 };
 
 static double
@@ -99,6 +288,9 @@ op_prcnt(double n)
 static double
 op_mod(double p, double q)
 {
+	if ((int64_t)q == 0)
+		return NAN;
+
 	return (double)((int64_t)p % (int64_t)q);
 }
 
@@ -107,13 +299,184 @@ op_fact(double n)
 {
 	double res, i;
 
+	/* No point in looping any further once we've overflowed. */
 	res = 1;
-	for (i = n; i > 1; --i)
+	for (i = n; i > 1 && isinf(res) == 0; --i)
 		res *= i;
 
 	return res;
 }
 
+/*
+ * Integer paths: these return -1 whenever the result doesn't fit in an
+ * int64_t.
+ */
+
+static int
+op_add_i(int64_t *res, const int64_t *args)
+{
+	if ((args[1] > 0 && args[0] > INT64_MAX - args[1])
+	    || (args[1] < 0 && args[0] < INT64_MIN - args[1]))
+		return -1;
+
+	*res = args[0] + args[1];
+
+	return 0;
+}
+
+static int
+op_subst_i(int64_t *res, const int64_t *args)
+{
+	if ((args[1] < 0 && args[0] > INT64_MAX + args[1])
+	    || (args[1] > 0 && args[0] < INT64_MIN + args[1]))
+		return -1;
+
+	*res = args[0] - args[1];
+
+	return 0;
+}
+
+static int
+op_mult_i(int64_t *res, const int64_t *args)
+{
+	int64_t p, q;
+
+	p = args[0];
+	q = args[1];
+	if (p > 0) {
+		if ((q > 0 && p > INT64_MAX / q) || (q < 0 && q < INT64_MIN / p))
+			return -1;
+	} else if (p < 0) {
+		if ((q > 0 && p < INT64_MIN / q) || (q < 0 && p < INT64_MAX / q))
+			return -1;
+	}
+
+	*res = p * q;
+
+	return 0;
+}
+
+static int
+op_mod_i(int64_t *res, const int64_t *args)
+{
+	if (args[1] == 0)
+		return -1;
+
+	/* INT64_MIN % -1 overflows */
+	*res = (args[1] == -1) ? 0 : args[0] % args[1];
+
+	return 0;
+}
+
+static int
+op_fact_i(int64_t *res, const int64_t *args)
+{
+	int64_t i, prod[2];
+
+	*res = 1;
+	for (i = args[0]; i > 1; --i) {
+		prod[0] = *res;
+		prod[1] = i;
+		if (op_mult_i(res, prod) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Typed paths: exact integer arithmetic when all arguments are integers,
+ * carried on into big integers in big integer mode when the result
+ * doesn't fit in an int64_t, and exact decimal arithmetic in decimal mode
+ * when all of them are integers or decimals. These return -1 whenever they
+ * can't handle their arguments or the result doesn't fit, so that the
+ * caller falls back to the double function.
+ */
+
+static int
+op_typed(Num *res, const Num *args, int n,
+         int (*ifunc)(int64_t *, const int64_t *),
+         int (*bfunc)(Num *, const Num *),
+         int (*dfunc)(NumDec *, const NumDec *))
+{
+	int i, all_int;
+	int64_t iargs[2];
+	NumDec dargs[2], dres;
+
+	all_int = 1;
+	for (i = 0; i < n; ++i) {
+		if (args[i].type != NUM_INT)
+			all_int = 0;
+		iargs[i] = args[i].v.i;
+	}
+
+	if (all_int != 0 && ifunc != NULL && (*ifunc)(&res->v.i, iargs) == 0) {
+		res->type = NUM_INT;
+		res->d = (double)res->v.i;
+		return 0;
+	}
+
+	if (big_mode != 0 && bfunc != NULL && (*bfunc)(res, args) == 0)
+		return 0;
+
+	if (dec_scale < 0 || dfunc == NULL)
+		return -1;
+
+	for (i = 0; i < n; ++i) {
+		if (dec_get(&dargs[i], &args[i]) < 0)
+			return -1;
+	}
+
+	if ((*dfunc)(&dres, dargs) < 0)
+		return -1;
+
+	dec_set(res, dres);
+
+	return 0;
+}
+
+static int
+op_add_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 2, op_add_i, big_add, dec_add);
+}
+
+static int
+op_subst_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 2, op_subst_i, big_subst, dec_subst);
+}
+
+static int
+op_mult_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 2, op_mult_i, big_mult, dec_mult);
+}
+
+static int
+op_div_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 2, NULL, NULL, dec_div);
+}
+
+static int
+op_prcnt_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 1, NULL, NULL, dec_prcnt);
+}
+
+static int
+op_mod_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 2, op_mod_i, big_mod, NULL);
+}
+
+static int
+op_fact_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 1, op_fact_i, big_fact, NULL);
+}
+
 static double
 op_npr(double n, double r)
 {
@@ -123,6 +486,12 @@ op_npr(double n, double r)
 	return op_fact(n) / op_fact(n - r);
 }
 
+static int
+op_npr_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 2, NULL, big_npr, NULL);
+}
+
 static double
 op_ncr(double n, double r)
 {
@@ -132,6 +501,12 @@ op_ncr(double n, double r)
 	return op_fact(n) / (op_fact(r) * op_fact(n - r));
 }
 
+static int
+op_ncr_t(Num *res, const Num *args)
+{
+	return op_typed(res, args, 2, NULL, big_ncr, NULL);
+}
+
 static double
 op_tan(double n)
 {
@@ -141,6 +516,26 @@ op_tan(double n)
 	return tan(n);
 }
 
+static void
+op_tan_v(double *res, const double *x, int n)
+{
+	int i;
+	double ax;
+
+	vec_tan(res, x, n);
+
+	/* 
+	 * Same poles as op_tan(). Exact multiples of OP_PI / 2 land either
+	 * very close to 0 or very far from it, so only those need fmod().
+	 */
+	for (i = 0; i < n; ++i) {
+		ax = fabs(x[i]) + 1;
+		if ((fabs(res[i]) < 1e-10 * ax || fabs(res[i]) * ax > 1e9
+		     || ax > 1e15) && fmod(x[i], OP_PI / 2) == 0)
+			res[i] = NAN;
+	}
+}
+
 static double
 op_cot(double n)
 {
@@ -189,47 +584,1012 @@ op_torad(double n)
 	return n * OP_PI / 180;
 }
 
+/*
+ * Derivatives: d1 functions return f'(x), d2 functions store both
+ * partials of f(p, q) into d[0] and d[1].
+ */
+
+static void
+op_add_d(double *d, double p, double q)
+{
+	(void)p;
+	(void)q;
+
+	d[0] = 1;
+	d[1] = 1;
+}
+
+static void
+op_subst_d(double *d, double p, double q)
+{
+	(void)p;
+	(void)q;
+
+	d[0] = 1;
+	d[1] = -1;
+}
+
+static void
+op_mult_d(double *d, double p, double q)
+{
+	d[0] = q;
+	d[1] = p;
+}
+
+static void
+op_div_d(double *d, double p, double q)
+{
+	d[0] = 1 / q;
+	d[1] = -p / (q * q);
+}
+
+static void
+op_pow_d(double *d, double p, double q)
+{
+	d[0] = q * pow(p, q - 1);
+
+	/* p^q is only differentiable in q where log(p) exists. */
+	if (p > 0)
+		d[1] = pow(p, q) * log(p);
+	else if (p == 0)
+		d[1] = 0;
+	else
+		d[1] = NAN;
+}
+
 static double
-op_cst_e(void)
+op_prcnt_d(double n)
 {
-	return OP_E;
+	(void)n;
+
+	return 0.01;
 }
 
 static double
-op_cst_pi(void)
+op_abs_d(double n)
 {
-	return OP_PI;
+	return (n > 0) - (n < 0);
 }
 
-const OpReg *
-op(const char *oper)
+static double
+op_ln_d(double n)
 {
-	const OpReg *ptr;
+	return 1 / n;
+}
 
-	for (ptr = op_defs; op_valid(ptr) == 0; ++ptr) {
-		if (strncmp(ptr->id, oper, OP_NAME_SIZE) == 0)
-			return ptr;
+static double
+op_sqrt_d(double n)
+{
+	return 0.5 / sqrt(n);
+}
+
+static void
+op_mod_d(double *d, double p, double q)
+{
+	/* Both operands are truncated to integers: piecewise constant. */
+	(void)p;
+	(void)q;
+
+	d[0] = 0;
+	d[1] = 0;
+}
+
+static double
+op_fact_s(double n)
+{
+	double res, i, f;
+
+	/*
+	 * d/dn of the product n (n - 1) ... over the product itself, i.e.
+	 * the sum of 1 / i over the same factors op_fact() multiplies.
+	 */
+	res = 0;
+	f = 1;
+	for (i = n; i > 1 && isinf(f) == 0; --i) {
+		f *= i;
+		res += 1 / i;
 	}
 
-	/* If no match is found, we return the "Null" pointer */
-	err = OP_ERR_INVALID;
-	return ptr;
+	return res;
 }
 
-int
-op_valid(const OpReg *ptr)
+static double
+op_fact_d(double n)
 {
-	switch (ptr->arg_n) {
-	case 2:
-		if (ptr->func.n0 == NULL)
-			return -1;
-		break;
-	case 1:
-		if (ptr->func.n1 == NULL)
+	return op_fact(n) * op_fact_s(n);
+}
+
+static void
+op_npr_d(double *d, double n, double r)
+{
+	double res;
+
+	res = op_npr(n, r);
+	d[0] = res * (op_fact_s(n) - op_fact_s(n - r));
+	d[1] = res * op_fact_s(n - r);
+}
+
+static void
+op_ncr_d(double *d, double n, double r)
+{
+	double res;
+
+	res = op_ncr(n, r);
+	d[0] = res * (op_fact_s(n) - op_fact_s(n - r));
+	d[1] = res * (op_fact_s(n - r) - op_fact_s(r));
+}
+
+static double
+op_cos_d(double n)
+{
+	return -sin(n);
+}
+
+static double
+op_tan_d(double n)
+{
+	double t;
+
+	t = op_tan(n);
+
+	return 1 + t * t;
+}
+
+static double
+op_cot_d(double n)
+{
+	double t;
+
+	t = op_cot(n);
+
+	return -(1 + t * t);
+}
+
+static double
+op_sec_d(double n)
+{
+	return op_sec(n) * tan(n);
+}
+
+static double
+op_csc_d(double n)
+{
+	return -op_csc(n) * op_cot(n);
+}
+
+static double
+op_asin_d(double n)
+{
+	return 1 / sqrt(1 - n * n);
+}
+
+static double
+op_acos_d(double n)
+{
+	return -op_asin_d(n);
+}
+
+static double
+op_atan_d(double n)
+{
+	return 1 / (1 + n * n);
+}
+
+static double
+op_acot_d(double n)
+{
+	return -op_atan_d(n);
+}
+
+static double
+op_asec_d(double n)
+{
+	return 1 / (fabs(n) * sqrt(n * n - 1));
+}
+
+static double
+op_acsc_d(double n)
+{
+	return -op_asec_d(n);
+}
+
+static double
+op_todeg_d(double n)
+{
+	(void)n;
+
+	return 180 / OP_PI;
+}
+
+static double
+op_torad_d(double n)
+{
+	(void)n;
+
+	return OP_PI / 180;
+}
+
+/* Reductions take at least min elements, all of them numbers */
+static int
+op_stk_check(const Stack *st, int min)
+{
+	int i;
+
+	if (st->sp + 1 < min) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	for (i = 0; i <= st->sp; ++i) {
+		if (st->type[i] == NUM_MAT) {
+			err = OP_ERR_TYPE;
 			return -1;
-		break;
-	case 0:
-		if (ptr->func.n0 == NULL)
+		}
+	}
+
+	return 0;
+}
+
+static int
+op_stk_set(Stack *st, double res)
+{
+	/* Reductions replace the whole stack with their result. */
+	st->sp = 0;
+	st->elems[0] = res;
+	st->type[0] = NUM_DBL;
+
+	return 0;
+}
+
+/* Whether any element isn't a double, and so may be kept exact */
+static int
+op_stk_typed(const Stack *st)
+{
+	int i;
+
+	for (i = 0; i <= st->sp; ++i) {
+		if (st->type[i] != NUM_DBL)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Reduces the stack element by element through tfunc, falling back to
+ * func as apply_op() does, so that sums and products of exact numbers
+ * stay exact.
+ */
+static int
+op_stk_fold(Stack *st, int (*tfunc)(Num *, const Num *),
+            double (*func)(double, double))
+{
+	int i;
+	Num args[2], res;
+
+	res.type = st->type[0];
+	res.v = st->vals[0];
+	res.d = st->elems[0];
+	for (i = 1; i <= st->sp; ++i) {
+		args[0] = res;
+		args[1].type = st->type[i];
+		args[1].v = st->vals[i];
+		args[1].d = st->elems[i];
+		if ((*tfunc)(&res, args) < 0) {
+			res.type = NUM_DBL;
+			res.d = (*func)(args[0].d, args[1].d);
+		}
+	}
+
+	st->sp = 0;
+	st->type[0] = res.type;
+	st->vals[0] = res.v;
+	st->elems[0] = res.d;
+
+	return 0;
+}
+
+static int
+op_stk_sum(Stack *st)
+{
+	if (op_stk_check(st, 1) < 0)
+		return -1;
+
+	if (op_stk_typed(st) != 0)
+		return op_stk_fold(st, op_add_t, op_add);
+
+	return op_stk_set(st, vec_sum(st->elems, st->sp + 1));
+}
+
+static int
+op_stk_ksum(Stack *st)
+{
+	if (op_stk_check(st, 1) < 0)
+		return -1;
+
+	if (op_stk_typed(st) != 0)
+		return op_stk_fold(st, op_add_t, op_add);
+
+	return op_stk_set(st, vec_ksum(st->elems, st->sp + 1));
+}
+
+static int
+op_stk_prod(Stack *st)
+{
+	if (op_stk_check(st, 1) < 0)
+		return -1;
+
+	if (op_stk_typed(st) != 0)
+		return op_stk_fold(st, op_mult_t, op_mult);
+
+	return op_stk_set(st, vec_prod(st->elems, st->sp + 1));
+}
+
+static int
+op_stk_min(Stack *st)
+{
+	if (op_stk_check(st, 1) < 0)
+		return -1;
+
+	return op_stk_set(st, vec_min(st->elems, st->sp + 1));
+}
+
+static int
+op_stk_max(Stack *st)
+{
+	if (op_stk_check(st, 1) < 0)
+		return -1;
+
+	return op_stk_set(st, vec_max(st->elems, st->sp + 1));
+}
+
+static int
+op_stk_dot(Stack *st)
+{
+	int half;
+
+	if (op_stk_check(st, 2) < 0)
+		return -1;
+
+	if ((st->sp + 1) % 2 != 0) {
+		err = OP_ERR_DIM;
+		return -1;
+	}
+
+	half = (st->sp + 1) / 2;
+
+	return op_stk_set(st, vec_dot(st->elems, st->elems + half, half));
+}
+
+/*
+ * Applies func to each element but the last, with the last one as its
+ * second operand, which is then popped. Stacks of doubles are done all at
+ * once through vfunc; otherwise elements go through tfunc one by one,
+ * falling back to func as apply_op() does.
+ */
+static int
+op_stk_apply(Stack *st, int (*tfunc)(Num *, const Num *),
+             double (*func)(double, double),
+             void (*vfunc)(double *, int, double))
+{
+	int i;
+	Num args[2], res;
+
+	if (op_stk_check(st, 2) < 0)
+		return -1;
+
+	if (op_stk_typed(st) == 0) {
+		(*vfunc)(st->elems, st->sp, st->elems[st->sp]);
+		--st->sp;
+		return 0;
+	}
+
+	args[1].type = st->type[st->sp];
+	args[1].v = st->vals[st->sp];
+	args[1].d = st->elems[st->sp];
+	for (i = 0; i < st->sp; ++i) {
+		args[0].type = st->type[i];
+		args[0].v = st->vals[i];
+		args[0].d = st->elems[i];
+		if ((*tfunc)(&res, args) < 0) {
+			res.type = NUM_DBL;
+			res.d = (*func)(args[0].d, args[1].d);
+		}
+		st->type[i] = res.type;
+		st->vals[i] = res.v;
+		st->elems[i] = res.d;
+	}
+	--st->sp;
+
+	return 0;
+}
+
+static int
+op_stk_add(Stack *st)
+{
+	return op_stk_apply(st, op_add_t, op_add, vec_offset);
+}
+
+static int
+op_stk_mult(Stack *st)
+{
+	return op_stk_apply(st, op_mult_t, op_mult, vec_scale);
+}
+
+static int
+op_poly(Stack *st)
+{
+	int i, n;
+	double deg, *args;
+
+	if (st->sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	deg = st->elems[st->sp];
+	if (deg != floor(deg) || deg < 0 || deg > STACK_SIZE) {
+		err = OP_ERR_DIM;
+		return -1;
+	}
+
+	/* x, then n + 1 coefficients, then n itself */
+	n = (int)deg;
+	if (n + 3 > st->sp + 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	for (i = st->sp - n - 2; i <= st->sp; ++i) {
+		if (st->type[i] == NUM_MAT) {
+			err = OP_ERR_TYPE;
+			return -1;
+		}
+	}
+
+	st->sp -= n + 2;
+	args = &st->elems[st->sp];
+	args[0] = vec_horner(&args[1], n, args[0]);
+	st->type[st->sp] = NUM_DBL;
+
+	return 0;
+}
+
+/*
+ * Stack operations over a DualStack: same semantics as their op_stk_*()
+ * counterparts, carrying the gradients along.
+ */
+
+static int
+op_dual_sum(DualStack *st)
+{
+	int i, j;
+
+	if (st->sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	for (i = 1; i <= st->sp; ++i) {
+		for (j = 0; j < st->n; ++j)
+			st->grad[0][j] += st->grad[i][j];
+	}
+	st->elems[0] = vec_sum(st->elems, st->sp + 1);
+	st->sp = 0;
+
+	return 0;
+}
+
+static int
+op_dual_ksum(DualStack *st)
+{
+	int i, j;
+
+	if (st->sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	for (i = 1; i <= st->sp; ++i) {
+		for (j = 0; j < st->n; ++j)
+			st->grad[0][j] += st->grad[i][j];
+	}
+	st->elems[0] = vec_ksum(st->elems, st->sp + 1);
+	st->sp = 0;
+
+	return 0;
+}
+
+static int
+op_dual_prod(DualStack *st)
+{
+	int i, j;
+	double pre[STACK_SIZE], suf, g[STACK_GRAD_MAX];
+
+	if (st->sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	/*
+	 * The partial for element i is the product of all the others:
+	 * prefix products going up, suffix products coming back down, so
+	 * zeros don't need to be divided out.
+	 */
+	pre[0] = 1;
+	for (i = 1; i <= st->sp; ++i)
+		pre[i] = pre[i - 1] * st->elems[i - 1];
+
+	memset(g, 0, sizeof(g));
+	suf = 1;
+	for (i = st->sp; i >= 0; --i) {
+		for (j = 0; j < st->n; ++j)
+			g[j] += pre[i] * suf * st->grad[i][j];
+		suf *= st->elems[i];
+	}
+
+	memcpy(st->grad[0], g, sizeof(g));
+	st->elems[0] = vec_prod(st->elems, st->sp + 1);
+	st->sp = 0;
+
+	return 0;
+}
+
+static int
+op_dual_pick(DualStack *st, double res)
+{
+	int i, j;
+
+	/* min and max follow whichever element they picked. */
+	for (i = 0; i <= st->sp && st->elems[i] != res; ++i)
+		;
+
+	if (i > st->sp) {
+		for (j = 0; j < st->n; ++j)
+			st->grad[0][j] = NAN;
+	} else if (i > 0) {
+		memcpy(st->grad[0], st->grad[i], st->n * sizeof(double));
+	}
+
+	st->elems[0] = res;
+	st->sp = 0;
+
+	return 0;
+}
+
+static int
+op_dual_min(DualStack *st)
+{
+	if (st->sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	return op_dual_pick(st, vec_min(st->elems, st->sp + 1));
+}
+
+static int
+op_dual_max(DualStack *st)
+{
+	if (st->sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	return op_dual_pick(st, vec_max(st->elems, st->sp + 1));
+}
+
+static int
+op_dual_dot(DualStack *st)
+{
+	int half, i, j;
+	double g[STACK_GRAD_MAX];
+
+	if (st->sp < 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	if ((st->sp + 1) % 2 != 0) {
+		err = OP_ERR_DIM;
+		return -1;
+	}
+
+	half = (st->sp + 1) / 2;
+
+	memset(g, 0, sizeof(g));
+	for (i = 0; i < half; ++i) {
+		for (j = 0; j < st->n; ++j)
+			g[j] += st->elems[half + i] * st->grad[i][j]
+			        + st->elems[i] * st->grad[half + i][j];
+	}
+
+	memcpy(st->grad[0], g, sizeof(g));
+	st->elems[0] = vec_dot(st->elems, st->elems + half, half);
+	st->sp = 0;
+
+	return 0;
+}
+
+static int
+op_dual_add(DualStack *st)
+{
+	int i, j;
+
+	if (st->sp < 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	for (i = 0; i < st->sp; ++i) {
+		for (j = 0; j < st->n; ++j)
+			st->grad[i][j] += st->grad[st->sp][j];
+	}
+	vec_offset(st->elems, st->sp, st->elems[st->sp]);
+	--st->sp;
+
+	return 0;
+}
+
+static int
+op_dual_mult(DualStack *st)
+{
+	int i, j;
+	double k;
+
+	if (st->sp < 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	k = st->elems[st->sp];
+	for (i = 0; i < st->sp; ++i) {
+		for (j = 0; j < st->n; ++j)
+			st->grad[i][j] = st->grad[i][j] * k
+			                 + st->elems[i] * st->grad[st->sp][j];
+	}
+	vec_scale(st->elems, st->sp, k);
+	--st->sp;
+
+	return 0;
+}
+
+static int
+op_dual_poly(DualStack *st)
+{
+	int n, i, j, base;
+	double deg, x, acc, g[STACK_GRAD_MAX];
+
+	if (st->sp < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	deg = st->elems[st->sp];
+	if (deg != floor(deg) || deg < 0 || deg > STACK_SIZE) {
+		err = OP_ERR_DIM;
+		return -1;
+	}
+
+	n = (int)deg;
+	if (n + 3 > st->sp + 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	/* Horner's scheme on (value, gradient) pairs. */
+	base = st->sp - n - 2;
+	x = st->elems[base];
+	acc = st->elems[base + 1];
+	memcpy(g, st->grad[base + 1], st->n * sizeof(double));
+	for (i = 1; i <= n; ++i) {
+		for (j = 0; j < st->n; ++j)
+			g[j] = g[j] * x + acc * st->grad[base][j]
+			       + st->grad[base + 1 + i][j];
+		acc = acc * x + st->elems[base + 1 + i];
+	}
+
+	memcpy(st->grad[base], g, st->n * sizeof(double));
+	st->elems[base] = vec_horner(&st->elems[base + 1], n, x);
+	st->sp = base;
+
+	return 0;
+}
+
+static Mat *
+op_stk_mat(Stack *st, int i)
+{
+	if (st->sp - i < 0) {
+		err = STACK_ERR_MIN;
+		return NULL;
+	}
+
+	if (st->type[st->sp - i] != NUM_MAT) {
+		err = OP_ERR_TYPE;
+		return NULL;
+	}
+
+	return st->vals[st->sp - i].m;
+}
+
+static int
+op_stk_dim(Stack *st, int i, int *dim)
+{
+	double d;
+
+	if (st->sp - i < 0) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	d = st->elems[st->sp - i];
+	if (d != floor(d) || d < 1 || d > MAT_DIM_MAX) {
+		err = OP_ERR_DIM;
+		return -1;
+	}
+
+	*dim = (int)d;
+
+	return 0;
+}
+
+static int
+op_stk_set_mat(Stack *st, int n, Mat *m)
+{
+	/* Replaces the last n elements in the stack with m */
+	if (m == NULL) {
+		err = MEM_ERR_ALLOC;
+		return -1;
+	}
+
+	st->sp -= n - 1;
+	st->elems[st->sp] = NAN;
+	st->type[st->sp] = NUM_MAT;
+	st->vals[st->sp].m = m;
+
+	return 0;
+}
+
+static int
+op_mat_new(Stack *st)
+{
+	int rows, cols;
+	Mat *m;
+
+	if (op_stk_dim(st, 1, &rows) < 0 || op_stk_dim(st, 0, &cols) < 0)
+		return -1;
+
+	if (rows * cols + 2 > st->sp + 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	if ((m = mat_new(rows, cols)) != NULL) {
+		memcpy(m->a, &st->elems[st->sp - 1 - rows * cols],
+		       rows * cols * sizeof(double));
+	}
+
+	return op_stk_set_mat(st, rows * cols + 2, m);
+}
+
+static int
+op_mat_eye(Stack *st)
+{
+	int i, n;
+	Mat *m;
+
+	if (op_stk_dim(st, 0, &n) < 0)
+		return -1;
+
+	if ((m = mat_new(n, n)) != NULL) {
+		memset(m->a, 0, n * n * sizeof(double));
+		for (i = 0; i < n; ++i)
+			m->a[i * n + i] = 1;
+	}
+
+	return op_stk_set_mat(st, 1, m);
+}
+
+static int
+op_mat_mult(Stack *st)
+{
+	Mat *a, *b, *c;
+
+	if ((b = op_stk_mat(st, 0)) == NULL || (a = op_stk_mat(st, 1)) == NULL)
+		return -1;
+
+	if (a->cols != b->rows) {
+		err = OP_ERR_DIM;
+		return -1;
+	}
+
+	if ((c = mat_new(a->rows, b->cols)) != NULL)
+		mat_mul(c, a, b);
+
+	return op_stk_set_mat(st, 2, c);
+}
+
+static int
+op_mat_trans(Stack *st)
+{
+	Mat *a, *t;
+
+	if ((a = op_stk_mat(st, 0)) == NULL)
+		return -1;
+
+	if ((t = mat_new(a->cols, a->rows)) != NULL)
+		mat_trans(t, a);
+
+	return op_stk_set_mat(st, 1, t);
+}
+
+static int
+op_mat_solve(Stack *st)
+{
+	int res;
+	Mat *a, *b, *x;
+
+	if ((b = op_stk_mat(st, 0)) == NULL || (a = op_stk_mat(st, 1)) == NULL)
+		return -1;
+
+	if (a->rows != a->cols || a->rows != b->rows) {
+		err = OP_ERR_DIM;
+		return -1;
+	}
+
+	if ((x = mat_new(b->rows, b->cols)) != NULL
+	    && (res = mat_solve(x, a, b)) < 0) {
+		err = (res == -2) ? MEM_ERR_ALLOC : OP_ERR_SINGULAR;
+		return -1;
+	}
+
+	return op_stk_set_mat(st, 2, x);
+}
+
+static int
+op_mat_det(Stack *st)
+{
+	Mat *a;
+
+	if ((a = op_stk_mat(st, 0)) == NULL)
+		return -1;
+
+	if (a->rows != a->cols) {
+		err = OP_ERR_DIM;
+		return -1;
+	}
+
+	st->elems[st->sp] = mat_det(a);
+	st->type[st->sp] = NUM_DBL;
+
+	return 0;
+}
+
+static double
+op_acc_mean(void)
+{
+	return stat_mean(&stat_acc);
+}
+
+static double
+op_acc_var(void)
+{
+	return stat_var(&stat_acc);
+}
+
+static double
+op_acc_stddev(void)
+{
+	return sqrt(stat_var(&stat_acc));
+}
+
+static double
+op_acc_sum(void)
+{
+	return stat_sum(&stat_acc);
+}
+
+static double
+op_acc_count(void)
+{
+	return stat_acc.n;
+}
+
+static double
+op_acc_min(void)
+{
+	return stat_min(&stat_acc);
+}
+
+static double
+op_acc_max(void)
+{
+	return stat_max(&stat_acc);
+}
+
+static double
+op_cst_e(void)
+{
+	return OP_E;
+}
+
+static double
+op_cst_pi(void)
+{
+	return OP_PI;
+}
+
+const OpReg *
+op(const char *oper)
+{
+	const OpReg *ptr, *plugin_ptr;
+
+	for (ptr = op_defs; op_valid(ptr) == 0; ++ptr) {
+		if (strncmp(ptr->id, oper, OP_NAME_SIZE) == 0)
+			return ptr;
+	}
+
+	/* Built-in operations take precedence over plugins. */
+	if ((plugin_ptr = plugin_op(oper)) != NULL)
+		return plugin_ptr;
+
+	/* If no match is found, we return the "Null" pointer */
+	err = OP_ERR_INVALID;
+	return ptr;
+}
+
+/* Whether ptr reads the accumulators */
+int
+op_acc(const OpReg *ptr)
+{
+	if (ptr->arg_n != 0)
+		return -1;
+
+	if (ptr->func.n0 == op_acc_mean || ptr->func.n0 == op_acc_var
+	    || ptr->func.n0 == op_acc_stddev || ptr->func.n0 == op_acc_sum
+	    || ptr->func.n0 == op_acc_count || ptr->func.n0 == op_acc_min
+	    || ptr->func.n0 == op_acc_max)
+		return 0;
+
+	return -1;
+}
+
+int
+op_pure(const OpReg *ptr)
+{
+	const OpReg *def;
+
+	/* Plugins may keep state, and so do the accumulators. */
+	for (def = op_defs; op_valid(def) == 0 && def != ptr; ++def)
+		;
+	if (def != ptr || op_valid(def) < 0)
+		return -1;
+
+	if (ptr->arg_n == 0 && ptr->func.n0 != op_cst_e
+	    && ptr->func.n0 != op_cst_pi)
+		return -1;
+
+	return (ptr->arg_n == OP_ARGS_STACK) ? -1 : 0;
+}
+
+int
+op_valid(const OpReg *ptr)
+{
+	switch (ptr->arg_n) {
+	case 2:
+		if (ptr->func.n0 == NULL)
+			return -1;
+		break;
+	case 1:
+		if (ptr->func.n1 == NULL)
+			return -1;
+		break;
+	case 0:
+		if (ptr->func.n0 == NULL)
+			return -1;
+		break;
+	case OP_ARGS_STACK:
+		if (ptr->func.ns == NULL)
 			return -1;
 		break;
 	default:
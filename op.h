@@ -2,6 +2,8 @@
 
 #define OP_NAME_SIZE 16
 #define OP_DESC_SIZE 64
+#define OP_ARGS_STACK 3 /* arg_n for operations on the whole stack */
+#define OP_ABI 1 /* Bump whenever OpReg changes, see plugin.c */
 
 typedef struct {
 	char id[OP_NAME_SIZE];
@@ -10,11 +12,24 @@ typedef struct {
 		double (*n0)(void);
 		double (*n1)(double);
 		double (*n2)(double, double);
+		int (*ns)(Stack *);
 	} func;
+	int (*tfunc)(Num *res, const Num *args); /* Optional, see op.c */
+	union {
+		void (*v1)(double *, const double *, int);
+		void (*v2)(double *, const double *, const double *, int);
+	} vfunc; /* Optional, applies func over whole arrays */
+	union {
+		double (*d1)(double);
+		void (*d2)(double *, double, double);
+		int (*ds)(DualStack *);
+	} dfunc; /* Optional, derivatives of func, see prog_grad() */
 	char desc[OP_DESC_SIZE];
 } OpReg;
 
 const OpReg *op(const char *oper);
+int op_acc(const OpReg *ptr);
+int op_pure(const OpReg *ptr);
 int op_valid(const OpReg *ptr);
 
 extern const OpReg op_defs[];
@@ -0,0 +1,80 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "par.h"
+
+typedef struct {
+	ParFunc func;
+	void *ctx;
+	long lo, hi;
+	int id;
+} ParJob;
+
+static void *par_worker(void *arg);
+
+static void *
+par_worker(void *arg)
+{
+	ParJob *job;
+
+	job = arg;
+	(*job->func)(job->ctx, job->lo, job->hi, job->id);
+
+	return NULL;
+}
+
+int
+par_threads(void)
+{
+	long n;
+
+	if ((n = SCALC_THREADS) <= 0 && (n = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		n = 1;
+
+	return (n > PAR_THREADS_MAX) ? PAR_THREADS_MAX : (int)n;
+}
+
+int
+par_for(long n, ParFunc func, void *ctx)
+{
+	int i, nthr, started[PAR_THREADS_MAX];
+	pthread_t thr[PAR_THREADS_MAX];
+	ParJob jobs[PAR_THREADS_MAX];
+
+	nthr = par_threads();
+	if (nthr > n)
+		nthr = (n > 0) ? (int)n : 1;
+
+	/* 
+	 * [0, n) is split into contiguous ranges, one for each thread, at
+	 * n i / nthr, computed so that it doesn't overflow for any n.
+	 */
+	for (i = 0; i < nthr; ++i) {
+		jobs[i].func = func;
+		jobs[i].ctx = ctx;
+		jobs[i].lo = n / nthr * i + n % nthr * i / nthr;
+		jobs[i].hi = n / nthr * (i + 1) + n % nthr * (i + 1) / nthr;
+		jobs[i].id = i;
+	}
+
+	/* 
+	 * Job 0 always runs on the calling thread. Should creating any other
+	 * thread fail, its job runs there as well, just not in parallel.
+	 */
+	for (i = 1; i < nthr; ++i)
+		started[i] = pthread_create(&thr[i], NULL, par_worker, &jobs[i]);
+
+	par_worker(&jobs[0]);
+
+	for (i = 1; i < nthr; ++i) {
+		if (started[i] == 0)
+			pthread_join(thr[i], NULL);
+		else
+			par_worker(&jobs[i]);
+	}
+
+	return nthr;
+}
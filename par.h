@@ -0,0 +1,8 @@
+/* See LICENSE file for copyright and license details. */
+
+#define PAR_THREADS_MAX 64
+
+typedef void (*ParFunc)(void *ctx, long lo, long hi, int id);
+
+int par_threads(void);
+int par_for(long n, ParFunc func, void *ctx);
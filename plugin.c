@@ -0,0 +1,105 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <stdint.h> /* Dependency for num.h, op.h */
+#include <stdio.h>
+#include <string.h>
+
+#include "num.h" /* Dependency for stack.h */
+#include "stack.h" /* Dependency for op.h */
+#include "op.h" /* Dependency for plugin.h */
+#include "plugin.h"
+
+static void *handles[PLUGIN_MAX];
+static const OpReg *tables[PLUGIN_MAX];
+static int plugin_n;
+
+int
+plugin_load(const char *dir)
+{
+	DIR *dp;
+	struct dirent *ent;
+	char path[FILENAME_MAX];
+	size_t len;
+	void *handle;
+	const int *abi;
+	const OpReg *table;
+
+	if ((dp = opendir(dir)) == NULL)
+		return -1;
+
+	while ((ent = readdir(dp)) != NULL && plugin_n < PLUGIN_MAX) {
+		len = strlen(ent->d_name);
+		if (len < 4 || strcmp(&ent->d_name[len - 3], ".so") != 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+			fprintf(stderr, "Warn: %s\n", dlerror());
+			continue;
+		}
+
+		/*
+		 * Plugins are built against op.h, so tables laid out for any
+		 * other version of OpReg would be misread.
+		 */
+		if ((abi = dlsym(handle, PLUGIN_ABI_SYM)) == NULL
+		    || *abi != OP_ABI) {
+			fprintf(stderr, "Warn: %s: %s is not %d.\n", path,
+			        PLUGIN_ABI_SYM, OP_ABI);
+			dlclose(handle);
+			continue;
+		}
+
+		/* Tables end with an invalid entry, just like op_defs. */
+		if ((table = dlsym(handle, PLUGIN_SYM)) == NULL) {
+			fprintf(stderr, "Warn: %s: no %s table.\n", path,
+			        PLUGIN_SYM);
+			dlclose(handle);
+			continue;
+		}
+
+		handles[plugin_n] = handle;
+		tables[plugin_n] = table;
+		++plugin_n;
+	}
+
+	closedir(dp);
+
+	return plugin_n;
+}
+
+void
+plugin_unload(void)
+{
+	while (plugin_n > 0) {
+		--plugin_n;
+		dlclose(handles[plugin_n]);
+	}
+}
+
+const OpReg *
+plugin_ops(int i)
+{
+	if (i < 0 || i >= plugin_n)
+		return NULL;
+
+	return tables[i];
+}
+
+const OpReg *
+plugin_op(const char *oper)
+{
+	int i;
+	const OpReg *ptr;
+
+	for (i = 0; i < plugin_n; ++i) {
+		for (ptr = tables[i]; op_valid(ptr) == 0; ++ptr) {
+			if (strncmp(ptr->id, oper, OP_NAME_SIZE) == 0)
+				return ptr;
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,10 @@
+/* See LICENSE file for copyright and license details. */
+
+#define PLUGIN_MAX 32
+#define PLUGIN_SYM "scalc_ops"
+#define PLUGIN_ABI_SYM "scalc_plugin_abi" /* const int, set to OP_ABI */
+
+int plugin_load(const char *dir);
+void plugin_unload(void);
+const OpReg *plugin_ops(int i);
+const OpReg *plugin_op(const char *oper);
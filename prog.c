@@ -0,0 +1,773 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h> /* Dependency for strlcpy.h */
+#include <stdint.h> /* Dependency for num.h, op.h */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "num.h" /* Dependency for big.h, dec.h, mem.h, stack.h, prog.h */
+#include "big.h"
+#include "dec.h"
+#include "stack.h" /* Dependency for mem.h, op.h, prog.h */
+#include "op.h" /* Dependency for prog.h */
+#include "prog.h" /* Dependency for mem.h */
+#include "mem.h"
+#include "strlcpy.h"
+#include "utils.h"
+
+static int parse_num(Num *dest, const char *str);
+static int apply_op(Num *dx, const OpReg *op_ptr, Stack *st);
+static long elapsed_ms(void);
+static int budget_check(void);
+static double sq(double n);
+static void sq_v(double *res, const double *x, int n);
+static double sq_d(double n);
+static int grad_zero(const DualStack *st, int from);
+static int grad_reg(DualStack *st, int reg, const int *seeds);
+static int grad_stk(DualStack *st, const OpReg *op_ptr);
+static int grad_op(DualStack *st, const OpReg *op_ptr);
+static int reduce(ProgIns *ins);
+
+/* What "2 ^" is reduced to by prog_opt() */
+static const OpReg sq_reg = {
+	"^", 1, { .n1 = sq }, NULL, { .v1 = sq_v }, { .d1 = sq_d }, "Square"
+};
+
+int prog_optimize = 1;
+long prog_eliminated;
+
+/*
+ * Budgets bound how much work a single line may take, across all threads
+ * evaluating programs for it. Operations are counted locally and only
+ * checked against the budget every PROG_CHECK_OPS operations, or sooner
+ * for smaller budgets, so that the dispatch loop stays cheap.
+ */
+static long ops_max = SCALC_OPS_MAX;
+static long time_max = SCALC_TIME_MAX;
+static long ops_every = PROG_CHECK_OPS;
+static long ops_done;
+static struct timespec start_time;
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread long ops_pending;
+
+/* Error to abort all running programs with, if not 0 */
+static volatile sig_atomic_t stop;
+
+static int
+parse_num(Num *dest, const char *str)
+{
+	char *endptr;
+
+	/* Integer literals are kept exact unless they overflow int64_t. */
+	errno = 0;
+	dest->v.i = strtoll(str, &endptr, 10);
+	if (endptr != str && endptr[0] == '\0' && errno == 0) {
+		dest->type = NUM_INT;
+		dest->d = (double)dest->v.i;
+		return 0;
+	}
+
+	/* In decimal mode, the rest of plain decimal literals are exact. */
+	if (dec_parse(dest, str) == 0)
+		return 0;
+
+	dest->type = NUM_DBL;
+	dest->d = strtod(str, &endptr);
+	if (endptr == str || endptr[0] != '\0')
+		return -1;
+
+	return 0;
+}
+
+static int
+apply_op(Num *dx, const OpReg *op_ptr, Stack *st)
+{
+	int arg_i, sp;
+	Num args[2];
+
+	/* 
+	 * Testing if there are enough elements in the stack before we pop them 
+	 * out so in case of a shortage, the elements already there are not
+	 * popped.
+	 */
+	if (op_ptr->arg_n > st->sp + 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	/* Traversing backwards because we're poping off the stack */
+	sp = st->sp;
+	for (arg_i = op_ptr->arg_n - 1; arg_i >= 0; --arg_i) {
+		args[arg_i].type = st->type[st->sp];
+		args[arg_i].v = st->vals[st->sp];
+		args[arg_i].d = st->elems[st->sp--];
+	}
+
+	/* 
+	 * Typed results that would overflow get promoted to double, unless
+	 * the typed path was cut short by the budget.
+	 */
+	if (op_ptr->tfunc != NULL && (*op_ptr->tfunc)(dx, args) == 0
+	    && stop == 0)
+		return 0;
+	if (stop != 0) {
+		err = stop;
+		st->sp = sp;
+		return -1;
+	}
+
+	/* Only typed paths take matrices; they're left on the stack. */
+	for (arg_i = 0; arg_i < op_ptr->arg_n; ++arg_i) {
+		if (args[arg_i].type == NUM_MAT) {
+			err = OP_ERR_TYPE;
+			st->sp = sp;
+			return -1;
+		}
+	}
+
+	dx->type = NUM_DBL;
+	if (op_ptr->arg_n == 2)
+		dx->d = (*op_ptr->func.n2)(args[0].d, args[1].d);
+	else if (op_ptr->arg_n == 1)
+		dx->d = (*op_ptr->func.n1)(args[0].d);
+	else
+		dx->d = (*op_ptr->func.n0)();
+	
+	return 0;
+}
+
+static long
+elapsed_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start_time.tv_sec) * 1000
+	       + (now.tv_nsec - start_time.tv_nsec) / 1000000;
+}
+
+static int
+budget_check(void)
+{
+	pthread_mutex_lock(&budget_lock);
+	ops_done += ops_pending;
+	ops_pending = 0;
+	if (stop == 0 && ((ops_max > 0 && ops_done > ops_max)
+	                  || (time_max > 0 && elapsed_ms() > time_max)))
+		stop = PROG_ERR_BUDGET;
+	pthread_mutex_unlock(&budget_lock);
+
+	if (stop != 0) {
+		err = stop;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Programs made of a single operation over the register reg, or the value
+ * already on the stack if reg is -1, and constants, such as "A sin" or
+ * "2 A ^", can be run over whole arrays of values for it at once, as long
+ * as the operation has a vfunc. Operations are only counted one by one,
+ * so this is never the case under an operation budget.
+ */
+int
+prog_vec_check(const Prog *prog, int reg)
+{
+	int i;
+	const ProgIns *ins;
+	const OpReg *op_ptr;
+
+	ins = prog->ins;
+	if (ops_max > 0 || prog->n < 1 || ins[prog->n - 1].type != PROG_OP)
+		return -1;
+
+	op_ptr = ins[prog->n - 1].arg.op;
+	if (op_ptr->arg_n != prog->n - 1 + (reg < 0)
+	    || (op_ptr->arg_n == 1 && op_ptr->vfunc.v1 == NULL)
+	    || (op_ptr->arg_n == 2 && op_ptr->vfunc.v2 == NULL))
+		return -1;
+
+	for (i = 0; i < prog->n - 1; ++i) {
+		if (ins[i].type == PROG_REG && reg >= 0 && ins[i].arg.reg == reg)
+			continue;
+		if (ins[i].type != PROG_NUM || ins[i].arg.num.type == NUM_MAT)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Runs a program accepted by prog_vec_check() for each value in x */
+int
+prog_vec_run(const Prog *prog, int reg, double *res, const double *x, int n)
+{
+	int i, j, k, m;
+	double cst[2][PROG_VEC_BLOCK];
+	const double *args[2];
+	const OpReg *op_ptr;
+
+	if (prog_poll() < 0)
+		return -1;
+
+	/* Constants are broadcast into arrays of their own. */
+	op_ptr = prog->ins[prog->n - 1].arg.op;
+	k = 0;
+	if (reg < 0)
+		++k;
+	for (i = 0; i < prog->n - 1; ++i, ++k) {
+		if (prog->ins[i].type == PROG_REG)
+			continue;
+		for (j = 0; j < PROG_VEC_BLOCK; ++j)
+			cst[k][j] = prog->ins[i].arg.num.d;
+	}
+
+	for (i = 0; i < n; i += PROG_VEC_BLOCK) {
+		m = (n - i < PROG_VEC_BLOCK) ? n - i : PROG_VEC_BLOCK;
+		for (j = 0; j < op_ptr->arg_n; ++j) {
+			if (j == 0 && reg < 0)
+				args[j] = &x[i];
+			else if (prog->ins[j - (reg < 0)].type == PROG_REG)
+				args[j] = &x[i];
+			else
+				args[j] = cst[j];
+		}
+
+		if (op_ptr->arg_n == 2)
+			(*op_ptr->vfunc.v2)(&res[i], args[0], args[1], m);
+		else
+			(*op_ptr->vfunc.v1)(&res[i], args[0], m);
+	}
+
+	return 0;
+}
+
+static double
+sq(double n)
+{
+	return n * n;
+}
+
+static void
+sq_v(double *res, const double *x, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i)
+		res[i] = x[i] * x[i];
+}
+
+static double
+sq_d(double n)
+{
+	return 2 * n;
+}
+
+/* 
+ * Strength reduction of ins[1], applied to a constant ins[0]. Returns the
+ * number of instructions removed, or -1 if nothing was done.
+ */
+static int
+reduce(ProgIns *ins)
+{
+	int exp;
+	Num *num;
+
+	/* Outside decimal mode, "^", "/" and "*" never take typed paths. */
+	num = &ins[0].arg.num;
+	if (dec_scale >= 0 || (num->type != NUM_INT && num->type != NUM_DBL)
+	    || op_pure(ins[1].arg.op) < 0)
+		return -1;
+
+	if (strcmp(ins[1].arg.op->id, "^") == 0 && num->d == 2) {
+		ins[0].type = PROG_OP;
+		ins[0].arg.op = &sq_reg;
+		ins[0].tok = ins[1].tok;
+		return 1;
+	}
+
+	/* Dividing by 2^k is the same as multiplying by 2^-k, if it exists. */
+	if (strcmp(ins[1].arg.op->id, "/") == 0 && isfinite(num->d)
+	    && fabs(frexp(num->d, &exp)) == 0.5 && exp >= DBL_MIN_EXP) {
+		num->type = NUM_DBL;
+		num->d = 1 / num->d;
+		ins[1].arg.op = op("*");
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * Peephole pass for programs about to be run: pure operations on
+ * constants are folded into their result, and some operations on a
+ * constant are reduced to cheaper ones. Results don't change, as typed
+ * paths are taken into account, save for "2 ^", which becomes correctly
+ * rounded. Typed operations aren't folded in big integer mode, as they
+ * may run for longer than any budget, which doesn't apply here yet. Programs run at a later time, such as bindings, are not to be
+ * optimized, as decimal mode may be turned on or off in between. Returns
+ * the number of instructions removed.
+ */
+int
+prog_opt(Prog *prog)
+{
+	int i, j, n, consts, removed;
+	Num dx;
+	Stack st;
+	const ProgIns *ins;
+	const OpReg *op_ptr;
+
+	if (prog_optimize == 0)
+		return 0;
+
+	/* consts is the number of constants last pushed by the new program. */
+	n = consts = 0;
+	for (i = 0; i < prog->n; ++i) {
+		ins = &prog->ins[i];
+		op_ptr = ins->arg.op;
+		if (ins->type == PROG_OP && op_pure(op_ptr) == 0
+		    && op_ptr->arg_n <= consts
+		    && (big_mode == 0 || op_ptr->tfunc == NULL)) {
+			st.sp = -1;
+			for (j = n - op_ptr->arg_n; j < n; ++j) {
+				++st.sp;
+				st.elems[st.sp] = prog->ins[j].arg.num.d;
+				st.type[st.sp] = prog->ins[j].arg.num.type;
+				st.vals[st.sp] = prog->ins[j].arg.num.v;
+			}
+
+			if (apply_op(&dx, op_ptr, &st) == 0) {
+				n -= op_ptr->arg_n;
+				consts -= op_ptr->arg_n;
+				prog->ins[n].type = PROG_NUM;
+				prog->ins[n].arg.num = dx;
+				prog->ins[n].tok = ins->tok;
+				++n;
+				++consts;
+				continue;
+			}
+		}
+
+		prog->ins[n] = *ins;
+		if (ins->type == PROG_OP && consts > 0
+		    && (removed = reduce(&prog->ins[n - 1])) >= 0) {
+			n += 1 - removed;
+			consts = 0;
+			continue;
+		}
+
+		consts = (ins->type == PROG_NUM) ? consts + 1 : 0;
+		++n;
+	}
+
+	removed = prog->n - n;
+	prog->n = n;
+	prog_eliminated += removed;
+
+	return removed;
+}
+
+void
+prog_budget(long ops, long ms)
+{
+	ops_max = ops;
+	time_max = ms;
+	ops_every = (ops > 0 && ops < PROG_CHECK_OPS) ? ops + 1 : PROG_CHECK_OPS;
+}
+
+void
+prog_start(void)
+{
+	ops_done = 0;
+	ops_pending = 0;
+	stop = 0;
+	if (time_max > 0)
+		clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+/*
+ * Budget check for operations that may run for long on their own, such as
+ * big integer ones. Returns -1, with err set, once the line is aborted.
+ */
+int
+prog_poll(void)
+{
+	if ((stop != 0 || time_max > 0) && budget_check() < 0)
+		return -1;
+
+	return 0;
+}
+
+void
+prog_abort(int code)
+{
+	/* Async-signal-safe, as this is meant to be called from handlers. */
+	stop = code;
+}
+
+int
+prog_compile(Prog *prog, const char *expr)
+{
+	Num dx;
+	char *ptr;
+	ProgIns *ins;
+	const OpReg *op_ptr;
+
+	prog->n = 0;
+	if (strlcpy(prog->buf, expr, PROG_BUF_SIZE) >= PROG_BUF_SIZE) {
+		err = PROG_ERR_SIZE;
+		return -1;
+	}
+
+	/* 
+	 * Invalid tokens are not reported right away. They are compiled into a
+	 * PROG_ERR instruction instead, so that running the program has the
+	 * same effect on the stack as evaluating the expression token by
+	 * token would. The rest of the tokens are still compiled, in case the
+	 * caller skips over it, see prog_skip().
+	 */
+	ptr = strtok(prog->buf, " ");
+	while (ptr != NULL) {
+		ins = &prog->ins[prog->n++];
+		ins->tok = ptr;
+
+		if (parse_num(&dx, ptr) == 0) {
+			ins->type = PROG_NUM;
+			ins->arg.num = dx;
+		} else if ((ins->arg.reg = mem_index(ptr)) >= 0) {
+			/* Names are resolved here, and never looked up again. */
+			ins->type = PROG_REG;
+		} else if (op_valid(op_ptr = op(ptr)) == 0) {
+			ins->type = PROG_OP;
+			ins->arg.op = op_ptr;
+		} else {
+			ins->type = PROG_ERR;
+			ins->arg.err = err;
+		}
+
+		ptr = strtok(NULL, " ");
+	}
+
+	return 0;
+}
+
+/* Drops instructions up to the one for tok, as reported by prog_run() */
+void
+prog_skip(Prog *prog, const char *tok)
+{
+	int i;
+
+	for (i = 0; i < prog->n && prog->ins[i].tok != tok; ++i)
+		;
+
+	if (i == prog->n) {
+		prog->n = 0;
+		return;
+	}
+
+	prog->n -= i + 1;
+	memmove(prog->ins, prog->ins + i + 1, prog->n * sizeof(ProgIns));
+}
+
+/* Whether prog reads the accumulators, see op_acc() */
+int
+prog_acc(const Prog *prog)
+{
+	int i;
+
+	for (i = 0; i < prog->n; ++i) {
+		if (prog->ins[i].type == PROG_OP
+		    && op_acc(prog->ins[i].arg.op) == 0)
+			return 0;
+	}
+
+	return -1;
+}
+
+int
+prog_run(const Prog *prog, Stack *st, const Num *regs, const char **errtok)
+{
+	Num dx;
+	const ProgIns *ins;
+
+	for (ins = prog->ins; ins < prog->ins + prog->n; ++ins) {
+		if ((stop != 0 || ++ops_pending >= ops_every)
+		    && budget_check() < 0)
+			goto fail;
+
+		switch (ins->type) {
+		case PROG_NUM:
+			dx = ins->arg.num;
+			break;
+		case PROG_REG:
+			/* Private registers, e.g. for threads, if we got any. */
+			if (regs != NULL)
+				dx = regs[ins->arg.reg];
+			else if (mem_get_num(&dx, ins->arg.reg) < 0)
+				goto fail;
+			break;
+		case PROG_OP:
+			/* Whole stack operations push their own results */
+			if (ins->arg.op->arg_n == OP_ARGS_STACK) {
+				if ((*ins->arg.op->func.ns)(st) < 0)
+					goto fail;
+				continue;
+			}
+
+			if (apply_op(&dx, ins->arg.op, st) < 0)
+				goto fail;
+			break;
+		default:
+			err = ins->arg.err;
+			goto fail;
+		}
+
+		/* Let's avoid stack overflows */
+		if (st->sp + 1 == STACK_SIZE) {
+			err = STACK_ERR_MAX;
+			goto fail;
+		}
+		++st->sp;
+		st->elems[st->sp] = dx.d;
+		st->type[st->sp] = dx.type;
+		st->vals[st->sp] = dx.v;
+	}
+
+	return 0;
+
+fail:
+	if (errtok != NULL)
+		*errtok = ins->tok;
+	return -1;
+}
+
+/* Whether all gradients from element from up to the top are zero */
+static int
+grad_zero(const DualStack *st, int from)
+{
+	int i, j;
+
+	for (i = from; i <= st->sp; ++i) {
+		for (j = 0; j < st->n; ++j) {
+			if (st->grad[i][j] != 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+grad_reg(DualStack *st, int reg, const int *seeds)
+{
+	int i;
+	Num num;
+	DualStack sub;
+	const Prog *bind;
+
+	/* Seeds are independent variables, even if they are bound. */
+	for (i = 0; i < st->n && seeds[i] != reg; ++i)
+		;
+
+	if (i == st->n && (bind = mem_prog(reg)) != NULL) {
+		sub.sp = -1;
+		sub.n = st->n;
+		if (prog_grad(bind, &sub, seeds, NULL) < 0)
+			return -1;
+
+		if (sub.sp < 0) {
+			err = STACK_ERR_MIN;
+			return -1;
+		}
+
+		st->elems[st->sp] = sub.elems[sub.sp];
+		memcpy(st->grad[st->sp], sub.grad[sub.sp], st->n * sizeof(double));
+		return 0;
+	}
+
+	if (mem_get_num(&num, reg) < 0)
+		return -1;
+
+	if (num.type == NUM_MAT) {
+		err = OP_ERR_TYPE;
+		return -1;
+	}
+
+	st->elems[st->sp] = num.d;
+	memset(st->grad[st->sp], 0, st->n * sizeof(double));
+	if (i < st->n)
+		st->grad[st->sp][i] = 1;
+
+	return 0;
+}
+
+/*
+ * Stack operations with no derivative, run on a plain copy of a stack of
+ * constants. Matrices can't be differentiated, so they can't come out.
+ */
+static int
+grad_stk(DualStack *st, const OpReg *op_ptr)
+{
+	int i;
+	Stack tmp;
+
+	if (grad_zero(st, 0) < 0) {
+		err = PROG_ERR_DIFF;
+		return -1;
+	}
+
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.sp = st->sp;
+	for (i = 0; i <= st->sp; ++i) {
+		tmp.elems[i] = st->elems[i];
+		tmp.type[i] = NUM_DBL;
+	}
+
+	if ((*op_ptr->func.ns)(&tmp) < 0)
+		return -1;
+
+	for (i = 0; i <= tmp.sp; ++i) {
+		if (tmp.type[i] == NUM_MAT) {
+			err = OP_ERR_TYPE;
+			return -1;
+		}
+		st->elems[i] = tmp.elems[i];
+		memset(st->grad[i], 0, st->n * sizeof(double));
+	}
+	st->sp = tmp.sp;
+
+	return 0;
+}
+
+static int
+grad_op(DualStack *st, const OpReg *op_ptr)
+{
+	int j, base;
+	double d[2], *ga, *gb;
+
+	if (op_ptr->arg_n == OP_ARGS_STACK) {
+		if (op_ptr->dfunc.ds != NULL)
+			return (*op_ptr->dfunc.ds)(st);
+		return grad_stk(st, op_ptr);
+	}
+
+	if (op_ptr->arg_n > st->sp + 1) {
+		err = STACK_ERR_MIN;
+		return -1;
+	}
+
+	/* 
+	 * Operations with no derivative still apply to constants. Zero
+	 * gradients are skipped, so that a partial that doesn't exist for
+	 * some operand, such as that of "^" for a negative base, doesn't
+	 * spoil the others.
+	 */
+	base = st->sp + 1 - op_ptr->arg_n;
+	if (op_ptr->dfunc.d1 == NULL && grad_zero(st, base) < 0) {
+		err = PROG_ERR_DIFF;
+		return -1;
+	}
+
+	ga = st->grad[base];
+	gb = st->grad[base + 1];
+	if (op_ptr->arg_n == 2) {
+		if (op_ptr->dfunc.d2 != NULL) {
+			(*op_ptr->dfunc.d2)(d, st->elems[base], st->elems[base + 1]);
+			for (j = 0; j < st->n; ++j) {
+				ga[j] = ((ga[j] != 0) ? d[0] * ga[j] : 0)
+				        + ((gb[j] != 0) ? d[1] * gb[j] : 0);
+			}
+		}
+		st->elems[base] = (*op_ptr->func.n2)(st->elems[base],
+		                                     st->elems[base + 1]);
+	} else if (op_ptr->arg_n == 1) {
+		if (op_ptr->dfunc.d1 != NULL) {
+			d[0] = (*op_ptr->dfunc.d1)(st->elems[base]);
+			for (j = 0; j < st->n; ++j) {
+				if (ga[j] != 0)
+					ga[j] *= d[0];
+			}
+		}
+		st->elems[base] = (*op_ptr->func.n1)(st->elems[base]);
+	} else {
+		/* Let's avoid stack overflows */
+		if (base == STACK_SIZE) {
+			err = STACK_ERR_MAX;
+			return -1;
+		}
+		st->elems[base] = (*op_ptr->func.n0)();
+		memset(st->grad[base], 0, st->n * sizeof(double));
+	}
+	st->sp = base;
+
+	return 0;
+}
+
+/*
+ * Forward-mode automatic differentiation: runs prog like prog_run() does,
+ * over doubles, carrying the gradient of every value with respect to the
+ * st->n registers in seeds. Bound registers are differentiated through
+ * their bindings.
+ */
+int
+prog_grad(const Prog *prog, DualStack *st, const int *seeds,
+          const char **errtok)
+{
+	const ProgIns *ins;
+
+	for (ins = prog->ins; ins < prog->ins + prog->n; ++ins) {
+		if ((stop != 0 || ++ops_pending >= ops_every)
+		    && budget_check() < 0)
+			goto fail;
+
+		if (ins->type == PROG_OP) {
+			if (grad_op(st, ins->arg.op) < 0)
+				goto fail;
+			continue;
+		}
+
+		if (ins->type == PROG_ERR) {
+			err = ins->arg.err;
+			goto fail;
+		}
+
+		/* Let's avoid stack overflows */
+		if (st->sp + 1 == STACK_SIZE) {
+			err = STACK_ERR_MAX;
+			goto fail;
+		}
+		++st->sp;
+
+		if (ins->type == PROG_REG) {
+			if (grad_reg(st, ins->arg.reg, seeds) < 0) {
+				--st->sp;
+				goto fail;
+			}
+			continue;
+		}
+
+		if (ins->arg.num.type == NUM_MAT) {
+			--st->sp;
+			err = OP_ERR_TYPE;
+			goto fail;
+		}
+		st->elems[st->sp] = ins->arg.num.d;
+		memset(st->grad[st->sp], 0, st->n * sizeof(double));
+	}
+
+	return 0;
+
+fail:
+	if (errtok != NULL)
+		*errtok = ins->tok;
+	return -1;
+}
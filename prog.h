@@ -0,0 +1,49 @@
+/* See LICENSE file for copyright and license details. */
+
+#define PROG_BUF_SIZE 256
+#define PROG_SIZE (PROG_BUF_SIZE / 2)
+#define PROG_CHECK_OPS 1024
+#define PROG_VEC_BLOCK 256 /* Values run at once by prog_vec_run() */
+
+enum {
+	PROG_NUM,
+	PROG_REG,
+	PROG_OP,
+	PROG_ERR
+};
+
+typedef struct {
+	int type;
+	union {
+		Num num;
+		int reg; /* Slot, see mem.c */
+		const OpReg *op;
+		int err;
+	} arg;
+	const char *tok;
+} ProgIns;
+
+typedef struct {
+	int n;
+	char buf[PROG_BUF_SIZE];
+	ProgIns ins[PROG_SIZE];
+} Prog;
+
+int prog_compile(Prog *prog, const char *expr);
+int prog_opt(Prog *prog);
+int prog_run(const Prog *prog, Stack *st, const Num *regs,
+             const char **errtok);
+void prog_skip(Prog *prog, const char *tok);
+int prog_acc(const Prog *prog);
+int prog_grad(const Prog *prog, DualStack *st, const int *seeds,
+              const char **errtok);
+int prog_vec_check(const Prog *prog, int reg);
+int prog_vec_run(const Prog *prog, int reg, double *res, const double *x,
+                 int n);
+void prog_budget(long ops, long ms);
+void prog_start(void);
+void prog_abort(int code);
+int prog_poll(void);
+
+extern int prog_optimize;
+extern long prog_eliminated;
@@ -0,0 +1,108 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <stddef.h> /* Dependency for strlcpy.h */
+#include <stdint.h> /* Dependency for num.h */
+#include <stdio.h>
+
+#include "num.h" /* Dependency for utils.h */
+#include "report.h"
+#include "strlcpy.h"
+#include "utils.h"
+
+typedef struct {
+	long line;
+	const char *name;
+	char tok[REPORT_TOK_SIZE];
+	char msg[REPORT_MSG_SIZE]; /* Copied, as it may come from strerror() */
+} ReportRec;
+
+int report_mode = REPORT_LOG;
+
+static ReportRec ring[REPORT_RING];
+static int ring_n;
+static long counts[ERR_COUNT];
+
+/*
+ * Reports err, raised at token tok of the given input line. Outside log
+ * mode, nothing is written until the ring fills up or scalc exits, as
+ * stderr is unbuffered and dirty input may fail on every other line.
+ */
+void
+report(long line, const char *tok)
+{
+	char *ptr;
+	ReportRec *rec;
+
+	++counts[err];
+	switch (report_mode) {
+	case REPORT_BATCH:
+		rec = &ring[ring_n++];
+		rec->line = line;
+		rec->name = errname();
+		strlcpy(rec->msg, errmsg(), REPORT_MSG_SIZE);
+		strlcpy(rec->tok, tok, REPORT_TOK_SIZE);
+		for (ptr = rec->tok; *ptr != '\0'; ++ptr) {
+			if (*ptr == '\t' || *ptr == '\n') /* Field separators */
+				*ptr = ' ';
+		}
+		if (ring_n == REPORT_RING)
+			report_flush();
+		break;
+	case REPORT_SUMMARY:
+		break;
+	default:
+		fprintf(stderr, "%s: %s\n", tok, errmsg());
+		break;
+	}
+}
+
+void
+report_flush(void)
+{
+	static char buf[REPORT_RING * (REPORT_TOK_SIZE + REPORT_MSG_SIZE + 64)];
+
+	int i, len;
+	size_t n;
+	const ReportRec *rec;
+
+	/* 
+	 * One line per record: line, error name, token and message,
+	 * tab-separated, all written at once. Names, unlike codes, don't
+	 * change as errors get added.
+	 */
+	n = 0;
+	for (i = 0; i < ring_n; ++i) {
+		rec = &ring[i];
+		len = snprintf(buf + n, sizeof(buf) - n, "%ld\t%s\t%s\t%s\n",
+		               rec->line, rec->name, rec->tok, rec->msg);
+		if (len < 0)
+			continue;
+		n += ((size_t)len < sizeof(buf) - n) ? (size_t)len
+		                                      : sizeof(buf) - n - 1;
+	}
+
+	if (n > 0)
+		fwrite(buf, 1, n, stderr);
+	ring_n = 0;
+}
+
+void
+report_end(void)
+{
+	int code, saved;
+
+	report_flush();
+	if (report_mode != REPORT_SUMMARY)
+		return;
+
+	/* errname() and errmsg() only know about err. */
+	saved = err;
+	for (code = NO_ERR + 1; code < ERR_COUNT; ++code) {
+		if (counts[code] == 0)
+			continue;
+		err = code;
+		fprintf(stderr, "%ld\t%s\t%s\n", counts[code], errname(),
+		        errmsg());
+	}
+	err = saved;
+}
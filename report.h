@@ -0,0 +1,17 @@
+/* See LICENSE file for copyright and license details. */
+
+#define REPORT_RING 1024 /* Records buffered before being written */
+#define REPORT_TOK_SIZE 64
+#define REPORT_MSG_SIZE 128
+
+enum {
+	REPORT_LOG, /* Each error as it happens, for humans */
+	REPORT_BATCH, /* Records, written in bulk */
+	REPORT_SUMMARY /* Counts for each error, at exit */
+};
+
+void report(long line, const char *tok);
+void report_flush(void);
+void report_end(void);
+
+extern int report_mode;
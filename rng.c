@@ -0,0 +1,164 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "rng.h"
+
+static uint64_t rng_splitmix(uint64_t *x);
+static uint64_t rng_rotl(uint64_t x, int k);
+static uint64_t rng_next(Rng *rng);
+static void rng_jump(Rng *rng, const uint64_t *poly);
+
+/* Each thread draws from its own xoshiro256** state. */
+__thread Rng rng_state;
+
+static uint64_t rng_base;
+static uint64_t rng_threads;
+static pthread_mutex_t rng_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Jump polynomials, advancing a state by 2^128 and 2^192 draws */
+static const uint64_t rng_jump_128[4] = {
+	0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+	0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+};
+static const uint64_t rng_jump_192[4] = {
+	0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+	0x77710069854ee241ULL, 0x39109bb02acbe635ULL
+};
+
+static uint64_t
+rng_splitmix(uint64_t *x)
+{
+	uint64_t z;
+
+	z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+static uint64_t
+rng_rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t
+rng_next(Rng *rng)
+{
+	int i;
+	uint64_t *s, res, t, x;
+
+	s = rng->s;
+	if ((s[0] | s[1] | s[2] | s[3]) == 0) {
+		/* Threads nobody gave a stream to seed themselves. */
+		pthread_mutex_lock(&rng_lock);
+		x = rng_base ^ ++rng_threads * 0xd1342543de82ef95ULL;
+		pthread_mutex_unlock(&rng_lock);
+		for (i = 0; i < 4; ++i)
+			s[i] = rng_splitmix(&x);
+	}
+
+	res = rng_rotl(s[1] * 5, 7) * 9;
+	t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rng_rotl(s[3], 45);
+
+	return res;
+}
+
+static void
+rng_jump(Rng *rng, const uint64_t *poly)
+{
+	int i, b, j;
+	uint64_t acc[4];
+
+	acc[0] = acc[1] = acc[2] = acc[3] = 0;
+	for (i = 0; i < 4; ++i) {
+		for (b = 0; b < 64; ++b) {
+			if ((poly[i] >> b) & 1) {
+				for (j = 0; j < 4; ++j)
+					acc[j] ^= rng->s[j];
+			}
+			rng_next(rng);
+		}
+	}
+
+	for (j = 0; j < 4; ++j)
+		rng->s[j] = acc[j];
+	rng->has_spare = 0;
+}
+
+void
+rng_seed(uint64_t seed)
+{
+	int i;
+
+	pthread_mutex_lock(&rng_lock);
+	rng_base = seed;
+	rng_threads = 0;
+	pthread_mutex_unlock(&rng_lock);
+
+	/* Expanded with SplitMix64, which never yields an all-zero state */
+	for (i = 0; i < 4; ++i)
+		rng_state.s[i] = rng_splitmix(&seed);
+	rng_state.has_spare = 0;
+}
+
+void
+rng_split(Rng *streams, int n)
+{
+	int i;
+	Rng cur;
+
+	/*
+	 * Streams are 2^128 draws apart, starting at the current state,
+	 * which then skips 2^192 draws so that it doesn't overlap them.
+	 */
+	cur = rng_state;
+	cur.has_spare = 0;
+	for (i = 0; i < n; ++i) {
+		streams[i] = cur;
+		rng_jump(&cur, rng_jump_128);
+	}
+	rng_jump(&rng_state, rng_jump_192);
+}
+
+double
+rng_unif(void)
+{
+	/* The top 53 bits, so that every value is a multiple of 2^-53 */
+	return (double)(rng_next(&rng_state) >> 11) * 0x1.0p-53;
+}
+
+double
+rng_norm(void)
+{
+	double u, v, s;
+
+	if (rng_state.has_spare != 0) {
+		rng_state.has_spare = 0;
+		return rng_state.spare;
+	}
+
+	/* Marsaglia's polar method */
+	do {
+		u = 2 * rng_unif() - 1;
+		v = 2 * rng_unif() - 1;
+		s = u * u + v * v;
+	} while (s >= 1 || s == 0);
+
+	s = sqrt(-2 * log(s) / s);
+	rng_state.spare = v * s;
+	rng_state.has_spare = 1;
+
+	return u * s;
+}
@@ -0,0 +1,14 @@
+/* See LICENSE file for copyright and license details. */
+
+typedef struct {
+	uint64_t s[4];
+	double spare; /* Second value drawn by rng_norm() */
+	int has_spare;
+} Rng;
+
+void rng_seed(uint64_t seed);
+void rng_split(Rng *streams, int n);
+double rng_unif(void);
+double rng_norm(void);
+
+extern __thread Rng rng_state;
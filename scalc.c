@@ -2,39 +2,56 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <stddef.h> /* Dependency for sline.h, strlcpy.h */
+#include <signal.h>
 #include <sline.h>
 #include <stdarg.h>
+#include <stdint.h> /* Dependency for num.h, op.h */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#include "stack.h" /* Dependency for cmd.h */
+#include "num.h" /* Dependency for stack.h, mem.h, utils.h */
+#include "stack.h" /* Dependency for cmd.h, mem.h */
 #include "cmd.h"
 #include "config.h"
+#include "op.h" /* Dependency for plugin.h, prog.h */
+#include "plugin.h"
+#include "prog.h" /* Dependency for mem.h */
 #include "mem.h"
-#include "op.h"
+#include "report.h"
+#include "rng.h"
+#include "stat.h"
 #include "strlcpy.h"
 #include "utils.h"
 
-#define SCALC_EXPR_SIZE 64
+#define SCALC_EXPR_SIZE 256
+#define SCALC_BIN_BLOCK 4096
 
 static void die(const char *fmt, ...);
 static void usage(void);
 static void cleanup(void);
 static const char *chomp_lead(const char *str);
 
+static void on_sigint(int sig);
+static void catch_sigint(int on);
 static void inter_setup(FILE *fp);
 static int file_input(char *expr, FILE *fp);
 static void prompt_input(char *expr);
 
 static void eval_cmd(const char *expr);
-static int apply_op(double *dx, const OpReg *op_ptr);
 static void eval_math(const char *expr);
 
+static double bin_swap(double num);
+static void bin_eval(const char *expr, const char *reg);
+
 static FILE *fp;
 static int sline_mode;
+static long line_n; /* Input lines read so far, for reports */
+static int nan_mode; /* Push NaN for failed tokens and carry on */
 
 static void
 die(const char *fmt, ...)
@@ -54,7 +71,8 @@ die(const char *fmt, ...)
 static void
 usage(void)
 {
-	die("usage: scalc [-iv] [file]");
+	die("usage: scalc [-inv] [-e log|batch|summary] [-b prog [-r reg]] "
+	    "[file]");
 }
 
 static void
@@ -63,6 +81,9 @@ cleanup(void)
 	if (sline_mode > 0)
 		sline_end();
 
+	plugin_unload();
+	report_end();
+
 	if (fp != stdin && fp != NULL)
 		fclose(fp);
 }
@@ -77,6 +98,30 @@ chomp_lead(const char *str)
 	return str;
 }
 
+static void
+on_sigint(int sig)
+{
+	(void)sig;
+
+	prog_abort(PROG_ERR_INTR);
+}
+
+/*
+ * While a line is being evaluated, ^C aborts it instead of scalc itself.
+ * Anywhere else, including the prompt, ^C keeps its default action.
+ */
+static void
+catch_sigint(int on)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = (on > 0) ? on_sigint : SIG_DFL;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+}
+
 static void
 inter_setup(FILE *fp)
 {
@@ -90,8 +135,6 @@ inter_setup(FILE *fp)
 static int
 file_input(char *expr, FILE *fp)
 {
-	static int line = 1;
-
 	int trash;
 	char *last_chr;
 
@@ -99,18 +142,17 @@ file_input(char *expr, FILE *fp)
 		return -1;
 
 	last_chr = &expr[strlen(expr) - 1];
+	++line_n;
 
 	/* Flushing stdin if there's more input; chomping '\n' if not. */
 	if (*last_chr != '\n') {
-		fprintf(stderr, "Warn: stdin: line %d truncated (too long).\n",
-		        line);
+		fprintf(stderr, "Warn: stdin: line %ld truncated (too long).\n",
+		        line_n);
 		while ((trash = fgetc(stdin)) != '\n' && trash != EOF);
 	} else {
 		*last_chr = '\0';
 	}
 
-	++line;
-
 	return 0;
 }
 
@@ -123,6 +165,8 @@ prompt_input(char *expr)
 
 	if (sline_stat < 0)
 		die("sline: %s", sline_errmsg());
+
+	++line_n;
 }
 
 static void
@@ -138,106 +182,207 @@ eval_cmd(const char *expr)
 	if (cmd_valid(cmd_ptr) < 0)
 		goto printerr;
 
-	expr_ptr = strtok(NULL, " ");
+	/* Commands get the rest of the line, as some take whole programs. */
+	if ((expr_ptr = strtok(NULL, "")) != NULL)
+		expr_ptr += strspn(expr_ptr, " ");
 	if ((*cmd_ptr->func)(expr_ptr) < 0)
 		goto printerr;
 
 	return;
 
 printerr:
-	fprintf(stderr, "%s: %s\n", expr, errmsg());
+	report(line_n, expr);
 }
 
-static int
-apply_op(double *dx, const OpReg *op_ptr)
+static void
+eval_math(const char *expr)
 {
-	int arg_i;
-	double args[2];
+	int acc;
+	Num dest;
+	const char *errtok;
+	Prog prog;
 
-	if (op_valid(op_ptr) < 0)
-		return -1;
+	errtok = expr;
+	if (prog_compile(&prog, expr) < 0)
+		goto printerr;
+	prog_opt(&prog);
+	acc = prog_acc(&prog);
 
 	/* 
-	 * Testing if there are enough elements in the stack before we pop them 
-	 * out so in case of a shortage, the elements already there are not
-	 * popped.
+	 * In NaN mode, failed tokens leave a NaN in place of their result and
+	 * the rest of the line is still evaluated. Aborted lines are not.
 	 */
-	if (op_ptr->arg_n > stack.sp + 1) {
-		err = STACK_ERR_MIN;
-		return -1;
+	while (prog_run(&prog, &stack, NULL, &errtok) < 0) {
+		if (nan_mode == 0 || err == PROG_ERR_BUDGET
+		    || err == PROG_ERR_INTR)
+			goto printerr;
+
+		report(line_n, errtok);
+		if (stack_push(NAN) < 0)
+			goto printerr;
+		prog_skip(&prog, errtok);
+		errtok = expr;
 	}
 
-	/* Traversing backwards because we're poping off the stack */
-	for (arg_i = op_ptr->arg_n - 1; arg_i >= 0; --arg_i) {
-		if (stack_pop(&args[arg_i]) < 0)
-			return -1;
+	if (stack_peek_num(&dest, 0) < 0)
+		goto printerr;
+
+	/*
+	 * In stat mode results are consumed instead of printed, except for
+	 * those of lines querying the accumulators, which would feed on
+	 * themselves.
+	 */
+	if (stat_stream != 0 && acc < 0) {
+		stat_add(&stat_acc, dest.d);
+		stack_drop(1);
+		return;
 	}
 
-	if (op_ptr->arg_n == 2)
-		*dx = (*op_ptr->func.n2)(args[0], args[1]);
-	else if (op_ptr->arg_n == 1)
-		*dx = (*op_ptr->func.n1)(args[0]);
-	else
-		*dx = (*op_ptr->func.n0)();
-	
-	return 0;
+	print_num(&dest);
+	return;
+
+printerr:
+	report(line_n, errtok);
 }
 
-static void
-eval_math(const char *expr)
+static double
+bin_swap(double num)
 {
-	double dest, dx;
-	char expr_cpy[SCALC_EXPR_SIZE];
-	char *ptr, *endptr;
-	const OpReg *op_ptr;
-
-	/* We need to operate on a copy, as strtok is destructive. */
-	strlcpy(expr_cpy, expr, SCALC_EXPR_SIZE);
-	ptr = strtok(expr_cpy, " ");
-	while (ptr != NULL) {
-		dx = strtof(ptr, &endptr);
-		if (endptr[0] == '\0')
-			goto pushnum; /* If number, skip further parsing */
+	int i;
+	uint16_t endian;
+	unsigned char buf[sizeof(double)], tmp;
+
+	/* Binary streams are little-endian; only big-endian hosts swap. */
+	endian = 1;
+	if (*(unsigned char *)&endian == 1)
+		return num;
+
+	memcpy(buf, &num, sizeof(double));
+	for (i = 0; i < (int)sizeof(double) / 2; ++i) {
+		tmp = buf[i];
+		buf[i] = buf[sizeof(double) - 1 - i];
+		buf[sizeof(double) - 1 - i] = tmp;
+	}
+	memcpy(&num, buf, sizeof(double));
 
-		if (mem_get(&dx, ptr[0]) == 0)
-			goto pushnum;
+	return num;
+}
 
-		op_ptr = op(ptr);
-		if (apply_op(&dx, op_ptr) < 0)
-			goto printerr;
+static void
+bin_eval(const char *expr, const char *reg)
+{
+	static double inbuf[SCALC_BIN_BLOCK], outbuf[SCALC_BIN_BLOCK];
+
+	size_t n, i;
+	long rec;
+	int vreg, vec;
+	double dest;
+	const char *errtok;
+	Prog prog;
+
+	/* The register goes first, so that the program can refer to it. */
+	vreg = -1;
+	if (reg != NULL
+	    && ((vreg = mem_intern(reg)) < 0 || mem_set(vreg, 0) < 0))
+		die("%s: %s", reg, errmsg());
+
+	if (prog_compile(&prog, expr) < 0)
+		die("%s: %s", expr, errmsg());
+	prog_opt(&prog);
+
+	/* Programs such as "A sin" are run a whole block at a time. */
+	vec = (prog_vec_check(&prog, vreg) == 0);
+
+	/* Errors are reported for each input value, counting from 1. */
+	rec = 0;
+	while ((n = fread(inbuf, sizeof(double), SCALC_BIN_BLOCK, fp)) > 0) {
+		if (vec) {
+			for (i = 0; i < n; ++i)
+				inbuf[i] = bin_swap(inbuf[i]);
+
+			err = NO_ERR; /* Reset err */
+			prog_start();
+			if (prog_vec_run(&prog, vreg, outbuf, inbuf, (int)n) < 0) {
+				report(rec + 1, expr);
+				for (i = 0; i < n; ++i)
+					outbuf[i] = NAN;
+			}
+			for (i = 0; i < n; ++i)
+				outbuf[i] = bin_swap(outbuf[i]);
+
+			if (vreg >= 0)
+				mem_set(vreg, inbuf[n - 1]);
+		}
 
-pushnum:
-		if (stack_push(dx) < 0)
-			goto printerr;
-		ptr = strtok(NULL, " ");
-	}
+		for (i = 0; i < n && vec == 0; ++i) {
+			err = NO_ERR; /* Reset err */
+			prog_start();
+			stack_init();
+			if (vreg >= 0)
+				mem_set(vreg, bin_swap(inbuf[i]));
+			else
+				stack_push(bin_swap(inbuf[i]));
+
+			/* Failed values are written as NaN to keep records aligned */
+			errtok = expr;
+			if (prog_run(&prog, &stack, NULL, &errtok) < 0
+			    || stack_peek(&dest, 0) < 0) {
+				report(rec + i + 1, errtok);
+				dest = NAN;
+			}
+			outbuf[i] = bin_swap(dest);
+		}
 
-	if (stack_peek(&dest, 0) < 0)
-		goto printerr;
+		if (fwrite(outbuf, sizeof(double), n, stdout) < n)
+			die("Could not write output: %s", strerror(errno));
 
-	print_num(dest);
-	return;
+		rec += n;
+		mem_collect(NULL, NULL);
+	}
 
-printerr:
-	fprintf(stderr, "%s: %s\n", ptr, errmsg());
+	if (ferror(fp) != 0)
+		die("Could not read input: %s", strerror(errno));
 }
 
 int
 main(int argc, char *argv[])
 {
-	char *filearg;
+	char *filearg, *binarg, *plugin_dir;
 	const char *expr_ptr;
 	char expr[SCALC_EXPR_SIZE];
+	char *binreg;
 	int opt, force_i;
+	Stack snap;
 	
 	atexit(cleanup);
 
 	force_i = -1;
-	while ((opt = getopt(argc, argv, ":iv")) != -1) {
+	binarg = NULL;
+	binreg = NULL;
+	while ((opt = getopt(argc, argv, ":b:e:inr:v")) != -1) {
 		switch (opt) {
+		case 'b':
+			binarg = optarg;
+			break;
+		case 'e':
+			if (strcmp(optarg, "log") == 0)
+				report_mode = REPORT_LOG;
+			else if (strcmp(optarg, "batch") == 0)
+				report_mode = REPORT_BATCH;
+			else if (strcmp(optarg, "summary") == 0)
+				report_mode = REPORT_SUMMARY;
+			else
+				usage();
+			break;
 		case 'i':
 			force_i = 0;
 			break;
+		case 'n':
+			nan_mode = 1;
+			break;
+		case 'r':
+			binreg = optarg;
+			break;
 		case 'v':
 			printf("scalc %s ", VERSION);
 			printf("(sline %s)\n", sline_version());
@@ -258,8 +403,20 @@ main(int argc, char *argv[])
 	else if ((fp = fopen(filearg, "r")) == NULL)
 		die("Could not open %s: %s", filearg, strerror(errno));
 
-	inter_setup(fp);
+	if ((plugin_dir = getenv("SCALC_PLUGIN_DIR")) == NULL)
+		plugin_dir = SCALC_PLUGIN_DIR;
+	plugin_load(plugin_dir);
+
 	stack_init();
+	rng_seed((uint64_t)time(NULL) ^ (uint64_t)getpid() << 32);
+	if (binarg != NULL) {
+		bin_eval(binarg, binreg);
+		return 0;
+	} else if (binreg != NULL) {
+		usage();
+	}
+
+	inter_setup(fp);
 	while (feof(fp) == 0) {
 		err = NO_ERR; /* Reset err */
 		if (sline_mode > 0) 
@@ -273,11 +430,23 @@ main(int argc, char *argv[])
 
 		if (strncmp(expr_ptr, ":quit", SCALC_EXPR_SIZE) == 0)
 			return 0;
-		else if (expr_ptr[0] == ':')
+
+		snap = stack;
+		prog_start();
+		if (sline_mode > 0)
+			catch_sigint(1);
+		if (expr_ptr[0] == ':')
 			eval_cmd(expr_ptr);
 		else
 			eval_math(expr_ptr);
+		if (sline_mode > 0)
+			catch_sigint(0);
+
+		/* Aborted lines leave the stack as it was before them. */
+		if (err == PROG_ERR_BUDGET || err == PROG_ERR_INTR)
+			stack = snap;
 
+		mem_collect(NULL, NULL);
 		continue;
 
 switch_and_bait:
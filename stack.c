@@ -1,8 +1,10 @@
 /* See LICENSE file for copyright and license details. */
 
+#include <stdint.h> /* Dependency for num.h */
 #include <stdlib.h>
 #include <string.h>
 
+#include "num.h" /* Dependency for stack.h */
 #include "stack.h"
 #include "utils.h"
 
@@ -25,6 +27,18 @@ stack_init(void)
 
 int
 stack_push(double elem)
+{
+	Num num;
+
+	memset(&num, 0, sizeof(num));
+	num.type = NUM_DBL;
+	num.d = elem;
+
+	return stack_push_num(&num);
+}
+
+int
+stack_push_num(const Num *elem)
 {
 	/* Let's avoid stack overflows */
 	if (++stack.sp == STACK_SIZE) {
@@ -33,7 +47,9 @@ stack_push(double elem)
 		return -1;
 	}
 
-	stack.elems[stack.sp] = elem;
+	stack.elems[stack.sp] = elem->d;
+	stack.type[stack.sp] = elem->type;
+	stack.vals[stack.sp] = elem->v;
 
 	return 0;
 }
@@ -67,12 +83,12 @@ stack_drop(int n)
 int
 stack_dup(void)
 {
-	double dup;
+	Num dup;
 
-	if (stack_peek(&dup, 0) < 0)
+	if (stack_peek_num(&dup, 0) < 0)
 		return -1;
 
-	if (stack_push(dup) < 0)
+	if (stack_push_num(&dup) < 0)
 		return -1;
 
 	return 0;
@@ -80,6 +96,19 @@ stack_dup(void)
 
 int
 stack_peek(double *dest, int i)
+{
+	Num num;
+
+	if (stack_peek_num(&num, i) < 0)
+		return -1;
+
+	*dest = num.d;
+
+	return 0;
+}
+
+int
+stack_peek_num(Num *dest, int i)
 {
 	int index;
 
@@ -88,7 +117,9 @@ stack_peek(double *dest, int i)
 		return -1;
 	}
 
-	*dest = stack.elems[index];
+	dest->d = stack.elems[index];
+	dest->type = stack.type[index];
+	dest->v = stack.vals[index];
 
 	return 0;
 }
@@ -96,7 +127,7 @@ stack_peek(double *dest, int i)
 int
 stack_swap(void)
 {
-	double ax, bx;
+	Num ax, bx;
 
 	/* If less than 2 elements in stack */
 	if (stack.sp < 1) {
@@ -105,10 +136,11 @@ stack_swap(void)
 	}
 
 	/* This is totally safe after the test above */
-	stack_pop(&ax);
-	stack_pop(&bx);
-	stack_push(ax);
-	stack_push(bx);
+	stack_peek_num(&ax, 0);
+	stack_peek_num(&bx, 1);
+	stack.sp -= 2;
+	stack_push_num(&ax);
+	stack_push_num(&bx);
 
 	return 0;
 }
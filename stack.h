@@ -1,18 +1,30 @@
 /* See LICENSE file for copyright and license details. */
 
 #define STACK_SIZE 32
+#define STACK_GRAD_MAX 16
 
 typedef struct {
 	int sp;
 	double elems[STACK_SIZE];
+	unsigned char type[STACK_SIZE];
+	NumVal vals[STACK_SIZE];
 } Stack;
 
+/* Values and their gradients over n seed registers, see prog_grad() */
+typedef struct {
+	int sp, n;
+	double elems[STACK_SIZE];
+	double grad[STACK_SIZE][STACK_GRAD_MAX];
+} DualStack;
+
 int stack_init(void);
 int stack_push(double elem);
+int stack_push_num(const Num *elem);
 int stack_pop(double *dest);
 int stack_drop(int n);
 int stack_dup(void);
 int stack_peek(double *dest, int i);
+int stack_peek_num(Num *dest, int i);
 int stack_swap(void);
 
 extern Stack stack;
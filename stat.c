@@ -0,0 +1,112 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <math.h>
+
+#include "stat.h"
+
+StatAcc stat_acc;
+int stat_stream;
+
+void
+stat_clr(StatAcc *acc)
+{
+	acc->n = 0;
+	acc->mean = acc->m2 = 0;
+	acc->sum = acc->comp = 0;
+	acc->min = acc->max = 0;
+}
+
+void
+stat_add(StatAcc *acc, double x)
+{
+	double delta, y, t;
+
+	++acc->n;
+
+	delta = x - acc->mean;
+	acc->mean += delta / acc->n;
+	acc->m2 += delta * (x - acc->mean);
+
+	y = x - acc->comp;
+	t = acc->sum + y;
+	acc->comp = (t - acc->sum) - y;
+	acc->sum = t;
+
+	if (acc->n == 1 || x < acc->min)
+		acc->min = x;
+	if (acc->n == 1 || x > acc->max)
+		acc->max = x;
+}
+
+void
+stat_merge(StatAcc *acc, const StatAcc *src)
+{
+	double n, delta, y, t;
+
+	if (src->n < 1)
+		return;
+	if (acc->n < 1) {
+		*acc = *src;
+		return;
+	}
+
+	/* Chan et al.'s pairwise update of the mean and squared deviations */
+	n = acc->n + src->n;
+	delta = src->mean - acc->mean;
+	acc->mean += delta * src->n / n;
+	acc->m2 += src->m2 + delta * delta * acc->n * src->n / n;
+	acc->n = n;
+
+	y = (src->sum - src->comp) - acc->comp;
+	t = acc->sum + y;
+	acc->comp = (t - acc->sum) - y;
+	acc->sum = t;
+
+	if (src->min < acc->min)
+		acc->min = src->min;
+	if (src->max > acc->max)
+		acc->max = src->max;
+}
+
+double
+stat_mean(const StatAcc *acc)
+{
+	if (acc->n < 1)
+		return NAN;
+
+	return acc->mean;
+}
+
+double
+stat_var(const StatAcc *acc)
+{
+	/* Sample variance */
+	if (acc->n < 2)
+		return NAN;
+
+	return acc->m2 / (acc->n - 1);
+}
+
+double
+stat_sum(const StatAcc *acc)
+{
+	return acc->sum;
+}
+
+double
+stat_min(const StatAcc *acc)
+{
+	if (acc->n < 1)
+		return NAN;
+
+	return acc->min;
+}
+
+double
+stat_max(const StatAcc *acc)
+{
+	if (acc->n < 1)
+		return NAN;
+
+	return acc->max;
+}
@@ -0,0 +1,20 @@
+/* See LICENSE file for copyright and license details. */
+
+typedef struct {
+	double n;
+	double mean, m2; /* Welford's running mean and squared deviations */
+	double sum, comp; /* Kahan's running sum and compensation */
+	double min, max;
+} StatAcc;
+
+void stat_clr(StatAcc *acc);
+void stat_add(StatAcc *acc, double x);
+void stat_merge(StatAcc *acc, const StatAcc *src);
+double stat_mean(const StatAcc *acc);
+double stat_var(const StatAcc *acc);
+double stat_sum(const StatAcc *acc);
+double stat_min(const StatAcc *acc);
+double stat_max(const StatAcc *acc);
+
+extern StatAcc stat_acc;
+extern int stat_stream;
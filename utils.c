@@ -1,24 +1,65 @@
 /* See LICENSE for copyright and license details. */
 
 #include <errno.h>
+#include <inttypes.h>
+#include <stdint.h> /* Dependency for num.h */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
+#include "mat.h"
+#include "num.h" /* Dependency for big.h, dec.h, utils.h */
+#include "big.h"
+#include "dec.h"
 #include "utils.h"
 
-int err = NO_ERR;
+/* Each thread keeps its own error, see par.c */
+__thread int err = NO_ERR;
 
 void
-print_num(double num)
+print_num(const Num *num)
 {
-	printf("%." SCALC_PREC "f\n", num);
+	int i, j;
+	char buf[DEC_STR_SIZE], *s;
+	const Mat *m;
+
+	switch (num->type) {
+	case NUM_INT:
+		printf("%" PRId64 "\n", num->v.i);
+		break;
+	case NUM_DEC:
+		puts(dec_fmt(buf, num));
+		break;
+	case NUM_BIG:
+		if ((s = big_fmt(num)) == NULL) {
+			printf("%." SCALC_PREC "f\n", num->d);
+			break;
+		}
+		puts(s);
+		free(s);
+		break;
+	case NUM_MAT:
+		m = num->v.m;
+		for (i = 0; i < m->rows; ++i) {
+			putchar('[');
+			for (j = 0; j < m->cols; ++j)
+				printf(" %." SCALC_PREC "f", m->a[i * m->cols + j]);
+			puts(" ]");
+		}
+		break;
+	default:
+		printf("%." SCALC_PREC "f\n", num->d);
+		break;
+	}
 }
 
 const char *
 errmsg(void)
 {
 	switch (err) {
+	case CMD_ERR_BAD_ARGS:
+		return "invalid arguments.";
 	case CMD_ERR_FEW_ARGS:
 		return "too few arguments passed.";
 	case CMD_ERR_FILE_IO:
@@ -27,12 +68,34 @@ errmsg(void)
 		return "invalid command.";
 	case CMD_ERR_WHATIS_NOT_FOUND:
 		return "nothing appropriate."; /* Like whatis(1)! */
+	case MEM_ERR_ALLOC:
+		return "out of memory.";
+	case MEM_ERR_CYCLE:
+		return "circular binding.";
+	case MEM_ERR_FULL:
+		return "too many variables.";
+	case MEM_ERR_NAME:
+		return "bad variable name.";
 	case MEM_ERR_NOT_FOUND:
 		return "bad register.";
 	case MEM_ERR_REG_ARG:
 		return "register required.";
+	case OP_ERR_DIM:
+		return "mismatched operand sizes.";
 	case OP_ERR_INVALID:
 		return "undefined operation.";
+	case OP_ERR_SINGULAR:
+		return "singular matrix.";
+	case OP_ERR_TYPE:
+		return "wrong operand type.";
+	case PROG_ERR_BUDGET:
+		return "evaluation budget exceeded.";
+	case PROG_ERR_DIFF:
+		return "operation has no derivative.";
+	case PROG_ERR_INTR:
+		return "interrupted.";
+	case PROG_ERR_SIZE:
+		return "expression too long.";
 	case STACK_ERR_MAX:
 		return "too many elements stored in stack.";
 	case STACK_ERR_MIN:
@@ -41,3 +104,55 @@ errmsg(void)
 		return "success.";
 	}
 }
+
+/* Name of err, as spelled in utils.h, for output read by other programs */
+const char *
+errname(void)
+{
+	switch (err) {
+	case CMD_ERR_BAD_ARGS:
+		return "CMD_ERR_BAD_ARGS";
+	case CMD_ERR_FEW_ARGS:
+		return "CMD_ERR_FEW_ARGS";
+	case CMD_ERR_FILE_IO:
+		return "CMD_ERR_FILE_IO";
+	case CMD_ERR_INVALID:
+		return "CMD_ERR_INVALID";
+	case CMD_ERR_WHATIS_NOT_FOUND:
+		return "CMD_ERR_WHATIS_NOT_FOUND";
+	case MEM_ERR_ALLOC:
+		return "MEM_ERR_ALLOC";
+	case MEM_ERR_CYCLE:
+		return "MEM_ERR_CYCLE";
+	case MEM_ERR_FULL:
+		return "MEM_ERR_FULL";
+	case MEM_ERR_NAME:
+		return "MEM_ERR_NAME";
+	case MEM_ERR_NOT_FOUND:
+		return "MEM_ERR_NOT_FOUND";
+	case MEM_ERR_REG_ARG:
+		return "MEM_ERR_REG_ARG";
+	case OP_ERR_DIM:
+		return "OP_ERR_DIM";
+	case OP_ERR_INVALID:
+		return "OP_ERR_INVALID";
+	case OP_ERR_SINGULAR:
+		return "OP_ERR_SINGULAR";
+	case OP_ERR_TYPE:
+		return "OP_ERR_TYPE";
+	case PROG_ERR_BUDGET:
+		return "PROG_ERR_BUDGET";
+	case PROG_ERR_DIFF:
+		return "PROG_ERR_DIFF";
+	case PROG_ERR_INTR:
+		return "PROG_ERR_INTR";
+	case PROG_ERR_SIZE:
+		return "PROG_ERR_SIZE";
+	case STACK_ERR_MAX:
+		return "STACK_ERR_MAX";
+	case STACK_ERR_MIN:
+		return "STACK_ERR_MIN";
+	default:
+		return "NO_ERR";
+	}
+}
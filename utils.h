@@ -2,18 +2,32 @@
 
 enum {
 	NO_ERR,
+	CMD_ERR_BAD_ARGS,
 	CMD_ERR_FEW_ARGS,
 	CMD_ERR_FILE_IO,
 	CMD_ERR_INVALID,
 	CMD_ERR_WHATIS_NOT_FOUND,
+	MEM_ERR_ALLOC,
+	MEM_ERR_CYCLE,
+	MEM_ERR_FULL,
+	MEM_ERR_NAME,
 	MEM_ERR_NOT_FOUND,
 	MEM_ERR_REG_ARG,
+	OP_ERR_DIM,
 	OP_ERR_INVALID,
+	OP_ERR_SINGULAR,
+	OP_ERR_TYPE,
+	PROG_ERR_BUDGET,
+	PROG_ERR_DIFF,
+	PROG_ERR_INTR,
+	PROG_ERR_SIZE,
 	STACK_ERR_MAX,
-	STACK_ERR_MIN
+	STACK_ERR_MIN,
+	ERR_COUNT /* Number of error codes, not an error itself */
 };
 
-void print_num(double num);
+void print_num(const Num *num);
 const char *errmsg(void);
+const char *errname(void);
 
-extern int err;
+extern __thread int err;
@@ -0,0 +1,883 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vec.h"
+
+#define VEC_BLOCK 64 /* Base case for pairwise summation */
+#define VEC_POLY_BLOCK 256 /* Points evaluated at once by vec_poly() */
+
+/* Constants for the transcendental kernels, mostly taken from fdlibm */
+#define VEC_ABS 0x7fffffffffffffffULL
+#define VEC_QNAN 0x7ff8000000000000ULL
+#define VEC_NORM_MIN 0x0010000000000000ULL /* DBL_MIN */
+#define VEC_NORM_MAX 0x7fefffffffffffffULL /* DBL_MAX */
+#define VEC_ROUND 0x1.8p52
+#define VEC_ROUND_BITS 0x4338000000000000ULL
+#define VEC_SPLIT 134217729.0 /* 2^27 + 1 */
+#define VEC_LOG2E 1.44269504088896338700e+00
+#define VEC_LN2_HI 6.93147180369123816490e-01
+#define VEC_LN2_LO 1.90821492927058770002e-10
+#define VEC_EXP_MAX 0x4086200000000000ULL /* 708.0 */
+#define VEC_EXP_P1 1.66666666666666019037e-01
+#define VEC_EXP_P2 -2.77777777770155933842e-03
+#define VEC_EXP_P3 6.61375632143793436117e-05
+#define VEC_EXP_P4 -1.65339022054652515390e-06
+#define VEC_EXP_P5 4.13813679705723846039e-08
+#define VEC_SQRT1_2 0x3fe6a09e667f3bcdULL /* sqrt(2) / 2 */
+#define VEC_LG1 6.666666666666735130e-01
+#define VEC_LG2 3.999999999940941908e-01
+#define VEC_LG3 2.857142874366239149e-01
+#define VEC_LG4 2.222219843214978396e-01
+#define VEC_LG5 1.818357216161805012e-01
+#define VEC_LG6 1.531383769920937332e-01
+#define VEC_LG7 1.479819860511658591e-01
+#define VEC_LOG_OFF 0x3fe6955500000000ULL /* Start of vec_logtab's range */
+#define VEC_LOG_N 64
+#define VEC_TRIG_MAX 0x4130000000000000ULL /* 2^20, largest reduced arg */
+#define VEC_INVPIO2 6.36619772367581382433e-01
+#define VEC_PIO2_1 1.57079632673412561417e+00
+#define VEC_PIO2_2 6.07710050630396597660e-11
+#define VEC_PIO2_3 2.02226624871116645580e-21
+#define VEC_PIO2_3T 8.47842766036889956997e-32
+#define VEC_S1 -1.66666666666666324348e-01
+#define VEC_S2 8.33333333332248946124e-03
+#define VEC_S3 -1.98412698298579493134e-04
+#define VEC_S4 2.75573137070700676789e-06
+#define VEC_S5 -2.50507602534068634195e-08
+#define VEC_S6 1.58969099521155010221e-10
+#define VEC_C1 4.16666666666666019037e-02
+#define VEC_C2 -1.38888888888741095749e-03
+#define VEC_C3 2.48015872894767294178e-05
+#define VEC_C4 -2.75573143513906633035e-07
+#define VEC_C5 2.08757232129817482790e-09
+#define VEC_C6 -1.13596475577881948265e-11
+
+/*
+ * Kernels use the compiler's vector types instead of relying on
+ * auto-vectorization, which selects, table lookups and reductions in a
+ * fixed order defeat. Reductions keep one vector of independent
+ * accumulators and handle tails separately. Kernels are always inlined, so that vectors never cross a call
+ * and their width doesn't leak into the calling convention. For the same
+ * reason, they take and return vectors through pointers, which also keeps
+ * GCC from warning about an ABI nothing ever uses (-Wpsabi). On x86_64,
+ * the entry points are also built for AVX2 and picked at load time.
+ */
+__extension__ typedef double VecD __attribute__((vector_size(32)));
+__extension__ typedef uint64_t VecU __attribute__((vector_size(32)));
+
+#define VEC_WIDTH (int)(sizeof(VecD) / sizeof(double))
+#define VEC_MUL_COLS (4 * VEC_WIDTH) /* Elements of c kept in registers */
+#define VEC_KERNEL static inline __attribute__((always_inline))
+
+#if defined(__x86_64__) && defined(__ELF__) && defined(__GNUC__)
+#define VEC_DISPATCH __attribute__((target_clones("avx2", "default")))
+#else
+#define VEC_DISPATCH
+#endif
+
+enum {
+	VEC_EXP,
+	VEC_LOG,
+	VEC_SIN,
+	VEC_COS,
+	VEC_TAN,
+	VEC_COT,
+	VEC_SEC,
+	VEC_CSC
+};
+
+/*
+ * For each of the VEC_LOG_N subintervals of [VEC_LOG_OFF, 2 * VEC_LOG_OFF),
+ * roughly 1/c for c the subinterval's center, and -log of that, as a
+ * double-double. Generated with 60 digit decimal arithmetic.
+ */
+static const double vec_logtab[VEC_LOG_N][3] = {
+	{ 0x1.68bfab1bb57a2p+0, -0x1.5f3c7bb0beb92p-2, -0x1.768fcbc7deab7p-57 },
+	{ 0x1.64d2061c23663p+0, -0x1.5406439a37874p-2, 0x1.aab918a3e9df6p-56 },
+	{ 0x1.60fa0b8110406p+0, -0x1.48ef21894ec93p-2, 0x1.58413fa389ddbp-56 },
+	{ 0x1.5d3709f6c74dap+0, -0x1.3df66af54e894p-2, 0x1.17cd577ad7015p-57 },
+	{ 0x1.598857a455d0ep+0, -0x1.331b7ac1eeac9p-2, 0x1.6b8e443cfb7e1p-56 },
+	{ 0x1.55ed51c7a4886p+0, -0x1.285db10512c48p-2, -0x1.901300ab52ab3p-58 },
+	{ 0x1.52655c57c1d28p+0, -0x1.1dbc72cf8e053p-2, -0x1.1863adb5a3959p-56 },
+	{ 0x1.4eefe1aceb16ep+0, -0x1.133729f8bda32p-2, -0x1.d52d3389dd929p-57 },
+	{ 0x1.4b8c522ded402p+0, -0x1.08cd44eccd472p-2, 0x1.f252ab22c6379p-56 },
+	{ 0x1.483a24027c6bcp+0, -0x1.fcfc6cfaf8c9cp-3, 0x1.e36c4fd27c029p-57 },
+	{ 0x1.44f8d2ca2a900p+0, -0x1.e892eb6a7c404p-3, 0x1.19770770f4f53p-57 },
+	{ 0x1.41c7df57abc68p+0, -0x1.d45cfb5920217p-3, -0x1.c9dfbc700eaa1p-57 },
+	{ 0x1.3ea6cf701d3e8p+0, -0x1.c0599ac2cd553p-3, -0x1.7c680f1873a0fp-57 },
+	{ 0x1.3b952d8e09a01p+0, -0x1.ac87cf2120972p-3, 0x1.a8322caea06adp-59 },
+	{ 0x1.389288a7eaf25p+0, -0x1.98e6a521e410ap-3, 0x1.8a08e1c861edbp-57 },
+	{ 0x1.359e73f9eeea9p+0, -0x1.8575306106711p-3, -0x1.c1e637bef3e19p-57 },
+	{ 0x1.32b886d2c6f97p+0, -0x1.72328b25dd221p-3, 0x1.bd20b0e1feb83p-57 },
+	{ 0x1.2fe05c635176cp+0, -0x1.5f1dd623826c2p-3, 0x1.2c85832021f11p-59 },
+	{ 0x1.2d159390ed07bp+0, -0x1.4c36383c237dfp-3, -0x1.d47fe3b9bf983p-62 },
+	{ 0x1.2a57ceca4ac3fp+0, -0x1.397ade47150e0p-3, 0x1.d0f84c6bb6b13p-58 },
+	{ 0x1.27a6b3de96c27p+0, -0x1.26eafad987f43p-3, 0x1.b407204f08bb1p-58 },
+	{ 0x1.2501ebd6d1988p+0, -0x1.1485c611b9803p-3, -0x1.bc20bf295bc46p-57 },
+	{ 0x1.226922d137ff7p+0, -0x1.024a7d647d9e8p-3, 0x1.95b78d936be7dp-57 },
+	{ 0x1.1fdc07de9844ap+0, -0x1.e070c6da05cc4p-4, 0x1.9d8fc79f8be71p-58 },
+	{ 0x1.1d5a4ce1776b1p+0, -0x1.bc9d7f7d655a2p-4, -0x1.c82c1585db16dp-59 },
+	{ 0x1.1ae3a66ee9f93p+0, -0x1.9919bd7222181p-4, 0x1.57e039d245363p-58 },
+	{ 0x1.1877cbb106578p+0, -0x1.75e422bb04c65p-4, 0x1.3982129d74174p-63 },
+	{ 0x1.1616764ad86c1p+0, -0x1.52fb5a4dbb21bp-4, 0x1.5a45b9a80a067p-58 },
+	{ 0x1.13bf623dbfc18p+0, -0x1.305e17c566fbcp-4, 0x1.714d42b8f7b8ep-64 },
+	{ 0x1.11724dd0230bfp+0, -0x1.0e0b17186c03fp-4, 0x1.d3fa2381d63d3p-58 },
+	{ 0x1.0f2ef9756544cp+0, -0x1.d80238a2a598bp-5, -0x1.18eeb02d7f2bfp-59 },
+	{ 0x1.0cf527b709e3ep+0, -0x1.947de69534226p-5, -0x1.93dcc500c89a7p-64 },
+	{ 0x1.0ac49d1ef6f00p+0, -0x1.5186dedaa2d8cp-5, 0x1.2f54679c0da44p-61 },
+	{ 0x1.089d2022c4bd3p+0, -0x1.0f1ad6e4b5810p-5, -0x1.b1b1b4a0644eep-60 },
+	{ 0x1.067e79100c3b0p+0, -0x1.9a6f2498c67cap-6, 0x1.2fcce253e97b0p-60 },
+	{ 0x1.046871f9a5a87p+0, -0x1.17b5c4bc66d96p-6, 0x1.e02eeb062f93dp-61 },
+	{ 0x1.025ad6a5ca6a1p+0, -0x1.2c0a96acb8eb1p-7, 0x1.01e930af3366dp-62 },
+	{ 0x1.0000000000000p+0, 0.0, 0.0 },
+	{ 0x1.f96b4f7e965d8p-1, 0x1.a7e7094dce1aep-7, 0x1.5480936b64e0ap-61 },
+	{ 0x1.f1bdeedc50048p-1, 0x1.cebb527a23867p-6, -0x1.2d09a1c194566p-60 },
+	{ 0x1.ea4b5eb06d242p-1, 0x1.62dda0587dfa2p-5, -0x1.2726467965032p-59 },
+	{ 0x1.e31105179b762p-1, 0x1.dc8807b0b5bb6p-5, -0x1.7e14ace471da6p-59 },
+	{ 0x1.dc0c6ee0a0d4bp-1, 0x1.2a354edecb5e7p-4, -0x1.5a9fca40f98eep-58 },
+	{ 0x1.d53b4cc716d9bp-1, 0x1.6549445b35907p-4, 0x1.f6a5e410997b3p-59 },
+	{ 0x1.ce9b70ea3abf3p-1, 0x1.9f862f9d641cfp-4, -0x1.6c324643f5f87p-59 },
+	{ 0x1.c82acc79f6ba7p-1, 0x1.d8f2183002f5dp-4, -0x1.7c4252c8e1087p-59 },
+	{ 0x1.c1e76d94eeacbp-1, 0x1.08c962cc0cbfbp-3, -0x1.3dfd12910b233p-57 },
+	{ 0x1.bbcf7d52ea920p-1, 0x1.24b6e1698bf12p-3, -0x1.b8f195cf6971cp-58 },
+	{ 0x1.b5e13df778445p-1, 0x1.404430cc5fc7ep-3, 0x1.b3c879688be86p-57 },
+	{ 0x1.b01b09490e3abp-1, 0x1.5b73deb2d8b95p-3, 0x1.e5af544250ef2p-57 },
+	{ 0x1.aa7b4f095be35p-1, 0x1.76485f297dd6ap-3, 0x1.6d6bba9e43c9ep-60 },
+	{ 0x1.a500938bcbb5bp-1, 0x1.90c40ddf4e077p-3, 0x1.a0598c095895ep-57 },
+	{ 0x1.9fa96e6788a20p-1, 0x1.aae92f6448e1bp-3, 0x1.00cd6413c6973p-58 },
+	{ 0x1.9a7489429d484p-1, 0x1.c4b9f253e3b41p-3, 0x1.3b012feddc876p-57 },
+	{ 0x1.95609eb40081bp-1, 0x1.de38706ceaaf4p-3, 0x1.4e9443dad9d0ep-57 },
+	{ 0x1.906c793a992d5p-1, 0x1.f766af982d0c7p-3, -0x1.8fa80132697d4p-57 },
+	{ 0x1.8b96f24773acbp-1, 0x1.0823516f9a9f2p-2, -0x1.a1598dc588031p-59 },
+	{ 0x1.86def1598ec7fp-1, 0x1.146d15aa199dbp-2, 0x1.6f62dda992c28p-58 },
+	{ 0x1.82436b29cc5f4p-1, 0x1.20918c7613478p-2, 0x1.6bfcb0e3832fcp-56 },
+	{ 0x1.7dc360e5b4f43p-1, 0x1.2c9195a61fdacp-2, 0x1.cbd17c8a6d08ap-56 },
+	{ 0x1.795ddf77dc1f6p-1, 0x1.386e0945ae1edp-2, 0x1.454ecba627022p-57 },
+	{ 0x1.7511fedccfe45p-1, 0x1.4427b7f437757p-2, 0x1.0795f569efacdp-56 },
+	{ 0x1.70dee18395e06p-1, 0x1.4fbf6b3b4a3e0p-2, 0x1.f470f698ec8e9p-56 },
+	{ 0x1.6cc3b3b8cfd90p-1, 0x1.5b35e5dfc3529p-2, 0x1.fca34bc32008dp-56 }
+};
+
+VEC_KERNEL void vec_dup(VecD *y, double x);
+VEC_KERNEL void vec_mask(VecU *m, const VecU *u, uint64_t lo, uint64_t hi);
+VEC_KERNEL void vec_sel(VecD *y, const VecU *m, const VecD *a, const VecD *b);
+VEC_KERNEL void vec_nan(VecD *y, const VecU *m);
+VEC_KERNEL void vec_twosum(VecD *hi, VecD *lo, const VecD *a, const VecD *b);
+VEC_KERNEL void vec_twoprod(VecD *hi, VecD *lo, const VecD *a, const VecD *b);
+VEC_KERNEL void vec_split(VecD *z, VecD *k, const VecD *x, uint64_t off);
+VEC_KERNEL void vec_kexp(VecD *y, const VecD *hi, const VecD *lo);
+VEC_KERNEL void vec_klog(VecD *y, const VecD *x);
+VEC_KERNEL void vec_klog2(VecD *hi, VecD *lo, const VecD *x);
+VEC_KERNEL void vec_kpow(VecD *y, const VecD *x, const VecD *e);
+VEC_KERNEL void vec_ksin(VecD *s, const VecD *x, const VecD *y);
+VEC_KERNEL void vec_kcos(VecD *c, const VecD *x, const VecD *y);
+VEC_KERNEL void vec_ksincos(VecD *s, VecD *c, const VecD *x);
+VEC_KERNEL void vec_kernel(VecD *y, const VecD *x, int f);
+VEC_KERNEL void vec_map(double *y, const double *x, int n, int f);
+static void vec_fixup(double *y, const double *x, int n, double (*f)(double));
+static double vec_sec_libm(double x);
+static double vec_csc_libm(double x);
+static double vec_cot_libm(double x);
+
+VEC_DISPATCH double
+vec_sum(const double *x, int n)
+{
+	int i, half;
+	double res;
+	VecD acc, v;
+
+	/* Pairwise summation: error grows with log(n) instead of n. */
+	if (n > VEC_BLOCK) {
+		half = n / 2;
+		return vec_sum(x, half) + vec_sum(x + half, n - half);
+	}
+
+	vec_dup(&acc, 0);
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&v, &x[i], sizeof(v));
+		acc += v;
+	}
+
+	res = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	for (; i < n; ++i)
+		res += x[i];
+
+	return res;
+}
+
+double
+vec_ksum(const double *x, int n)
+{
+	int i;
+	double sum, comp, t;
+
+	/* Neumaier's variant of Kahan's compensated summation */
+	sum = comp = 0;
+	for (i = 0; i < n; ++i) {
+		t = sum + x[i];
+		if (fabs(sum) >= fabs(x[i]))
+			comp += (sum - t) + x[i];
+		else
+			comp += (x[i] - t) + sum;
+		sum = t;
+	}
+
+	return sum + comp;
+}
+
+VEC_DISPATCH double
+vec_prod(const double *x, int n)
+{
+	int i;
+	double res;
+	VecD acc, v;
+
+	vec_dup(&acc, 1);
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&v, &x[i], sizeof(v));
+		acc *= v;
+	}
+
+	res = (acc[0] * acc[1]) * (acc[2] * acc[3]);
+	for (; i < n; ++i)
+		res *= x[i];
+
+	return res;
+}
+
+VEC_DISPATCH double
+vec_min(const double *x, int n)
+{
+	int i, j;
+	double res;
+	VecD acc, v;
+	VecU m;
+
+	res = x[0];
+	vec_dup(&acc, x[0]);
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&v, &x[i], sizeof(v));
+		m = (VecU)(v < acc);
+		vec_sel(&acc, &m, &v, &acc);
+	}
+
+	for (j = 0; j < VEC_WIDTH; ++j)
+		res = (acc[j] < res) ? acc[j] : res;
+	for (; i < n; ++i)
+		res = (x[i] < res) ? x[i] : res;
+
+	return res;
+}
+
+VEC_DISPATCH double
+vec_max(const double *x, int n)
+{
+	int i, j;
+	double res;
+	VecD acc, v;
+	VecU m;
+
+	res = x[0];
+	vec_dup(&acc, x[0]);
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&v, &x[i], sizeof(v));
+		m = (VecU)(v > acc);
+		vec_sel(&acc, &m, &v, &acc);
+	}
+
+	for (j = 0; j < VEC_WIDTH; ++j)
+		res = (acc[j] > res) ? acc[j] : res;
+	for (; i < n; ++i)
+		res = (x[i] > res) ? x[i] : res;
+
+	return res;
+}
+
+VEC_DISPATCH double
+vec_dot(const double *x, const double *y, int n)
+{
+	int i;
+	double res;
+	VecD acc, u, v;
+
+	vec_dup(&acc, 0);
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&u, &x[i], sizeof(u));
+		memcpy(&v, &y[i], sizeof(v));
+		acc += u * v;
+	}
+
+	res = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	for (; i < n; ++i)
+		res += x[i] * y[i];
+
+	return res;
+}
+
+VEC_DISPATCH void
+vec_scale(double *x, int n, double k)
+{
+	int i;
+	VecD kv, v;
+
+	vec_dup(&kv, k);
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&v, &x[i], sizeof(v));
+		v *= kv;
+		memcpy(&x[i], &v, sizeof(v));
+	}
+	for (; i < n; ++i)
+		x[i] *= k;
+}
+
+double
+vec_horner(const double *c, int n, double x)
+{
+	int i;
+	double res;
+
+	/* c holds the n + 1 coefficients, highest degree first. */
+	res = c[0];
+	for (i = 1; i <= n; ++i)
+		res = res * x + c[i];
+
+	return res;
+}
+
+void
+vec_poly(double *y, const double *x, int m, const double *c, int n)
+{
+	int i, j, k, end;
+
+	/*
+	 * Horner's scheme for m points at once: with the loop over points
+	 * innermost, every step is an independent multiply-add per point.
+	 */
+	for (i = 0; i < m; i += VEC_POLY_BLOCK) {
+		end = (i + VEC_POLY_BLOCK < m) ? i + VEC_POLY_BLOCK : m;
+		for (j = i; j < end; ++j)
+			y[j] = c[0];
+		for (k = 1; k <= n; ++k) {
+			for (j = i; j < end; ++j)
+				y[j] = y[j] * x[j] + c[k];
+		}
+	}
+}
+
+VEC_DISPATCH void
+vec_offset(double *x, int n, double k)
+{
+	int i;
+	VecD kv, v;
+
+	vec_dup(&kv, k);
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&v, &x[i], sizeof(v));
+		v += kv;
+		memcpy(&x[i], &v, sizeof(v));
+	}
+	for (; i < n; ++i)
+		x[i] += k;
+}
+
+/*
+ * Transcendental kernels. Each one runs fdlibm's argument reductions and
+ * polynomials over whole vectors, without branches, and then hands values
+ * out of the kernel's range (marked as NaN) over to libm. Largest errors,
+ * measured against long double over 4e6 uniform samples per range:
+ *
+ *   vec_exp            [-700, 700]                    0.88 ULP
+ *   vec_log            [0.5, 2], [1e-300, 1e300]      0.82 ULP
+ *   vec_sin, vec_cos   [-4, 4], [-1e6, 1e6]           0.78 ULP
+ *   vec_pow            [0.01, 100] ^ [-100, 100]      0.88 ULP
+ *   vec_sec, vec_csc   [-1e6, 1e6]                    1.57 ULP
+ *   vec_tan, vec_cot   [-4, 4], [-1e6, 1e6]           2.21 ULP
+ */
+
+/* x in every element; x - 0 is x, even for x = -0 */
+static void
+vec_dup(VecD *y, double x)
+{
+	*y = x - (VecD){ 0 };
+}
+
+/* All ones where lo <= u <= hi, all zeros elsewhere */
+static void
+vec_mask(VecU *m, const VecU *u, uint64_t lo, uint64_t hi)
+{
+	*m = (((*u - lo) | (hi - *u)) >> 63) - 1;
+}
+
+/* a where m is set, b elsewhere */
+static void
+vec_sel(VecD *y, const VecU *m, const VecD *a, const VecD *b)
+{
+	*y = (VecD)(((VecU)*a & *m) | ((VecU)*b & ~*m));
+}
+
+/* NaN where m is not set */
+static void
+vec_nan(VecD *y, const VecU *m)
+{
+	*y = (VecD)(((VecU)*y & *m) | (VEC_QNAN & ~*m));
+}
+
+/* Exact a + b = hi + lo */
+static void
+vec_twosum(VecD *hi, VecD *lo, const VecD *a, const VecD *b)
+{
+	VecD s, bb;
+
+	s = *a + *b;
+	bb = s - *a;
+	*lo = (*a - (s - bb)) + (*b - bb);
+	*hi = s;
+}
+
+/* Exact a * b = hi + lo, barring overflow (Dekker) */
+static void
+vec_twoprod(VecD *hi, VecD *lo, const VecD *a, const VecD *b)
+{
+	VecD c, ah, al, bh, bl;
+
+	c = VEC_SPLIT * *a;
+	ah = c - (c - *a);
+	al = *a - ah;
+	c = VEC_SPLIT * *b;
+	bh = c - (c - *b);
+	bl = *b - bh;
+	*hi = *a * *b;
+	*lo = ((ah * bh - *hi) + ah * bl + al * bh) + al * bl;
+}
+
+/* Splits x into 2^k * z, with z's bits in [off, off + 2^52) */
+static void
+vec_split(VecD *z, VecD *k, const VecD *x, uint64_t off)
+{
+	VecU tmp;
+
+	tmp = (VecU)*x - off;
+	*k = (VecD)(VEC_ROUND_BITS + (((tmp >> 52) ^ 0x800) - 0x800))
+	     - VEC_ROUND;
+	*z = (VecD)((VecU)*x - (tmp & 0xfffULL << 52));
+}
+
+/* exp(hi + lo), NaN where out of range */
+static void
+vec_kexp(VecD *y, const VecD *hi, const VecD *lo)
+{
+	VecD t, k, rhi, rlo, r, r2, c;
+	VecU ax;
+
+	/* Adding VEC_ROUND rounds to an integer, left in the low bits. */
+	t = *hi * VEC_LOG2E + VEC_ROUND;
+	k = t - VEC_ROUND;
+
+	rhi = *hi - k * VEC_LN2_HI;
+	rlo = k * VEC_LN2_LO - *lo;
+	r = rhi - rlo;
+	r2 = r * r;
+	c = r - r2 * (VEC_EXP_P1 + r2 * (VEC_EXP_P2 + r2 * (VEC_EXP_P3
+	    + r2 * (VEC_EXP_P4 + r2 * VEC_EXP_P5))));
+	ax = (VecU)*hi & VEC_ABS;
+	vec_mask(&ax, &ax, 0, VEC_EXP_MAX);
+
+	*y = 1.0 - ((rlo - (r * c) / (2.0 - c)) - rhi);
+	*y *= (VecD)(((VecU)t - VEC_ROUND_BITS + 1023) << 52);
+	vec_nan(y, &ax);
+}
+
+/* log(x), NaN where x is not a positive normal number */
+static void
+vec_klog(VecD *y, const VecD *x)
+{
+	VecD k, f, s, z, w, r, hfsq;
+	VecU m;
+
+	vec_split(&f, &k, x, VEC_SQRT1_2);
+	f -= 1.0;
+	s = f / (2.0 + f);
+	z = s * s;
+	w = z * z;
+	r = z * (VEC_LG1 + w * (VEC_LG3 + w * (VEC_LG5 + w * VEC_LG7)))
+	    + w * (VEC_LG2 + w * (VEC_LG4 + w * VEC_LG6));
+	hfsq = 0.5 * f * f;
+	m = (VecU)*x;
+	vec_mask(&m, &m, VEC_NORM_MIN, VEC_NORM_MAX);
+
+	*y = k * VEC_LN2_HI - ((hfsq - (s * (hfsq + r) + k * VEC_LN2_LO)) - f);
+	vec_nan(y, &m);
+}
+
+/* log(x) = hi + lo to about 2^-66, for vec_kpow() */
+static void
+vec_klog2(VecD *hi, VecD *lo, const VecD *x)
+{
+	int j;
+	VecD k, z, c, lc, lct, ph, pl, rh, rl, qh, ql, t, u;
+	VecD h1, h2, h3, e1, e2, e3;
+	VecU i;
+
+	/* x = 2^k * z, with log(z) = log(c) + log(1 + r) and |r| < 0.008 */
+	vec_split(&z, &k, x, VEC_LOG_OFF);
+	i = (((VecU)*x - VEC_LOG_OFF) >> 46) % VEC_LOG_N;
+	c = lc = lct = (VecD){ 0 };
+	for (j = 0; j < VEC_WIDTH; ++j) {
+		c[j] = vec_logtab[i[j]][0];
+		lc[j] = vec_logtab[i[j]][1];
+		lct[j] = vec_logtab[i[j]][2];
+	}
+
+	vec_twoprod(&ph, &pl, &z, &c);
+	t = ph - 1.0;
+	vec_twosum(&rh, &rl, &t, &pl);
+
+	/* log(1 + r) = r - r^2 / 2 + r^3 * P(r), only r^2 needs more bits. */
+	vec_twoprod(&qh, &ql, &rh, &rh);
+	ql += 2.0 * rh * rl;
+	t = rh * qh * (1.0 / 3 + rh * (-1.0 / 4 + rh * (1.0 / 5 + rh * (-1.0 / 6
+	    + rh * (1.0 / 7 + rh * (-1.0 / 8 + rh * (1.0 / 9
+	    + rh * (-1.0 / 10))))))));
+
+	u = k * VEC_LN2_HI;
+	vec_twosum(&h1, &e1, &u, &lc);
+	vec_twosum(&h2, &e2, &h1, &rh);
+	u = -0.5 * qh;
+	vec_twosum(&h3, &e3, &h2, &u);
+	e1 += e2 + e3 + k * VEC_LN2_LO + lct + rl - 0.5 * ql + t;
+	*hi = h3 + e1;
+	*lo = e1 - (*hi - h3);
+}
+
+/* x^e, NaN where x is not a positive normal number or out of range */
+static void
+vec_kpow(VecD *y, const VecD *x, const VecD *e)
+{
+	VecD lh, ll, th, tl, hi, lo;
+	VecU m;
+
+	vec_klog2(&lh, &ll, x);
+	vec_twoprod(&th, &tl, e, &lh);
+	tl += *e * ll;
+	hi = th + tl;
+	lo = tl - (hi - th);
+	m = (VecU)*x;
+	vec_mask(&m, &m, VEC_NORM_MIN, VEC_NORM_MAX);
+
+	vec_kexp(y, &hi, &lo);
+	vec_nan(y, &m);
+}
+
+/* sin(x + y), with |x| <= pi/4 and y a tail to x */
+static void
+vec_ksin(VecD *s, const VecD *x, const VecD *y)
+{
+	VecD z, v, r;
+
+	z = *x * *x;
+	v = z * *x;
+	r = VEC_S2 + z * (VEC_S3 + z * (VEC_S4 + z * (VEC_S5 + z * VEC_S6)));
+
+	*s = *x - ((z * (0.5 * *y - v * r) - *y) - v * VEC_S1);
+}
+
+/* cos(x + y), with |x| <= pi/4 and y a tail to x */
+static void
+vec_kcos(VecD *c, const VecD *x, const VecD *y)
+{
+	VecD z, w, r, hz;
+
+	z = *x * *x;
+	w = z * z;
+	r = z * (VEC_C1 + z * (VEC_C2 + z * VEC_C3))
+	    + w * w * (VEC_C4 + z * (VEC_C5 + z * VEC_C6));
+	hz = 0.5 * z;
+	w = 1.0 - hz;
+
+	*c = w + (((1.0 - w) - hz) + (z * r - *x * *y));
+}
+
+/* sin(x) and cos(x), NaN where x is out of range */
+static void
+vec_ksincos(VecD *s, VecD *c, const VecD *x)
+{
+	VecD t, fn, r, lo, a, b, e1, e2, ks, kc;
+	VecU q, odd, ax, m;
+
+	/* x - fn * pi/2 = r + lo, with |r| <= pi/4 (Cody-Waite) */
+	t = *x * VEC_INVPIO2 + VEC_ROUND;
+	fn = t - VEC_ROUND;
+	q = (VecU)t;
+
+	/* Products are exact, as fn has at most 20 bits. */
+	a = *x - fn * VEC_PIO2_1;
+	b = -fn * VEC_PIO2_2;
+	vec_twosum(&r, &e1, &a, &b);
+	b = -fn * VEC_PIO2_3;
+	vec_twosum(&r, &e2, &r, &b);
+	lo = e1 + e2 - fn * VEC_PIO2_3T;
+	t = r + lo;
+	lo -= t - r;
+	vec_ksin(&ks, &t, &lo);
+	vec_kcos(&kc, &t, &lo);
+
+	/* The quadrant picks the kernel and the sign. */
+	odd = 0 - (q & 1);
+	vec_sel(s, &odd, &kc, &ks);
+	vec_sel(c, &odd, &ks, &kc);
+	*s = (VecD)((VecU)*s ^ (q & 2) << 62);
+	*c = (VecD)((VecU)*c ^ ((q + 1) & 2) << 62);
+
+	/* Keeping the sign of zero */
+	ax = (VecU)*x & VEC_ABS;
+	vec_mask(&m, &ax, 0, 0);
+	vec_sel(s, &m, x, s);
+	vec_mask(&m, &ax, 0, VEC_TRIG_MAX);
+	vec_nan(s, &m);
+	vec_nan(c, &m);
+}
+
+/* Kernel f over x, where f is a constant once inlined */
+static void
+vec_kernel(VecD *y, const VecD *x, int f)
+{
+	VecD s, c;
+
+	switch (f) {
+	case VEC_EXP:
+		c = *x * 0;
+		vec_kexp(y, x, &c);
+		return;
+	case VEC_LOG:
+		vec_klog(y, x);
+		return;
+	}
+
+	vec_ksincos(&s, &c, x);
+	switch (f) {
+	case VEC_SIN:
+		*y = s;
+		break;
+	case VEC_COS:
+		*y = c;
+		break;
+	case VEC_TAN:
+		*y = s / c;
+		break;
+	case VEC_COT:
+		*y = c / s;
+		break;
+	case VEC_SEC:
+		*y = 1.0 / c;
+		break;
+	default: /* VEC_CSC */
+		*y = 1.0 / s;
+		break;
+	}
+}
+
+/* y[i] = f(x[i]), a whole vector at a time */
+static void
+vec_map(double *y, const double *x, int n, int f)
+{
+	int i;
+	double buf[VEC_WIDTH];
+	VecD v;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&v, &x[i], sizeof(v));
+		vec_kernel(&v, &v, f);
+		memcpy(&y[i], &v, sizeof(v));
+	}
+
+	/* The tail is padded with zeros. */
+	if (i < n) {
+		memset(buf, 0, sizeof(buf));
+		memcpy(buf, &x[i], (n - i) * sizeof(double));
+		memcpy(&v, buf, sizeof(v));
+		vec_kernel(&v, &v, f);
+		memcpy(buf, &v, sizeof(v));
+		memcpy(&y[i], buf, (n - i) * sizeof(double));
+	}
+}
+
+static void
+vec_fixup(double *y, const double *x, int n, double (*f)(double))
+{
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		if (isnan(y[i]))
+			y[i] = (*f)(x[i]);
+	}
+}
+
+static double
+vec_sec_libm(double x)
+{
+	return 1 / cos(x);
+}
+
+static double
+vec_csc_libm(double x)
+{
+	return 1 / sin(x);
+}
+
+static double
+vec_cot_libm(double x)
+{
+	return 1 / tan(x);
+}
+
+VEC_DISPATCH void
+vec_exp(double *y, const double *x, int n)
+{
+	vec_map(y, x, n, VEC_EXP);
+	vec_fixup(y, x, n, exp);
+}
+
+VEC_DISPATCH void
+vec_log(double *y, const double *x, int n)
+{
+	vec_map(y, x, n, VEC_LOG);
+	vec_fixup(y, x, n, log);
+}
+
+VEC_DISPATCH void
+vec_pow(double *y, const double *x, const double *e, int n)
+{
+	int i;
+	double bx[VEC_WIDTH], be[VEC_WIDTH];
+	VecD vx, ve;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		memcpy(&vx, &x[i], sizeof(vx));
+		memcpy(&ve, &e[i], sizeof(ve));
+		vec_kpow(&vx, &vx, &ve);
+		memcpy(&y[i], &vx, sizeof(vx));
+	}
+
+	if (i < n) {
+		memset(bx, 0, sizeof(bx));
+		memset(be, 0, sizeof(be));
+		memcpy(bx, &x[i], (n - i) * sizeof(double));
+		memcpy(be, &e[i], (n - i) * sizeof(double));
+		memcpy(&vx, bx, sizeof(vx));
+		memcpy(&ve, be, sizeof(ve));
+		vec_kpow(&vx, &vx, &ve);
+		memcpy(bx, &vx, sizeof(vx));
+		memcpy(&y[i], bx, (n - i) * sizeof(double));
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (isnan(y[i]))
+			y[i] = pow(x[i], e[i]);
+	}
+}
+
+VEC_DISPATCH void
+vec_sin(double *y, const double *x, int n)
+{
+	vec_map(y, x, n, VEC_SIN);
+	vec_fixup(y, x, n, sin);
+}
+
+VEC_DISPATCH void
+vec_cos(double *y, const double *x, int n)
+{
+	vec_map(y, x, n, VEC_COS);
+	vec_fixup(y, x, n, cos);
+}
+
+VEC_DISPATCH void
+vec_tan(double *y, const double *x, int n)
+{
+	vec_map(y, x, n, VEC_TAN);
+	vec_fixup(y, x, n, tan);
+}
+
+VEC_DISPATCH void
+vec_cot(double *y, const double *x, int n)
+{
+	vec_map(y, x, n, VEC_COT);
+	vec_fixup(y, x, n, vec_cot_libm);
+}
+
+VEC_DISPATCH void
+vec_sec(double *y, const double *x, int n)
+{
+	vec_map(y, x, n, VEC_SEC);
+	vec_fixup(y, x, n, vec_sec_libm);
+}
+
+VEC_DISPATCH void
+vec_csc(double *y, const double *x, int n)
+{
+	vec_map(y, x, n, VEC_CSC);
+	vec_fixup(y, x, n, vec_csc_libm);
+}
+
+/*
+ * c += a * b over a block of rows x cols elements of c, with inner
+ * columns of a and rows of b, and ldc, lda and ldb the row lengths of
+ * the underlying matrices. Each stretch of VEC_MUL_COLS elements of a row
+ * of c stays in vector registers while the whole inner loop runs.
+ */
+VEC_DISPATCH void
+vec_mul_block(double *c, int ldc, const double *a, int lda, const double *b,
+              int ldb, int rows, int inner, int cols)
+{
+	int i, j, k, m;
+	double aik, *cr;
+	const double *br;
+	VecD ak, b0, b1, b2, b3, c0, c1, c2, c3;
+
+	for (i = 0; i < rows; ++i) {
+		cr = &c[i * ldc];
+		for (j = 0; j + VEC_MUL_COLS <= cols; j += VEC_MUL_COLS) {
+			memcpy(&c0, &cr[j], sizeof(c0));
+			memcpy(&c1, &cr[j + VEC_WIDTH], sizeof(c1));
+			memcpy(&c2, &cr[j + 2 * VEC_WIDTH], sizeof(c2));
+			memcpy(&c3, &cr[j + 3 * VEC_WIDTH], sizeof(c3));
+			for (k = 0; k < inner; ++k) {
+				/* Broadcast, keeping the sign of zero */
+				ak = a[i * lda + k] - (VecD){ 0 };
+				br = &b[k * ldb + j];
+				memcpy(&b0, br, sizeof(b0));
+				memcpy(&b1, br + VEC_WIDTH, sizeof(b1));
+				memcpy(&b2, br + 2 * VEC_WIDTH, sizeof(b2));
+				memcpy(&b3, br + 3 * VEC_WIDTH, sizeof(b3));
+				c0 += ak * b0;
+				c1 += ak * b1;
+				c2 += ak * b2;
+				c3 += ak * b3;
+			}
+			memcpy(&cr[j], &c0, sizeof(c0));
+			memcpy(&cr[j + VEC_WIDTH], &c1, sizeof(c1));
+			memcpy(&cr[j + 2 * VEC_WIDTH], &c2, sizeof(c2));
+			memcpy(&cr[j + 3 * VEC_WIDTH], &c3, sizeof(c3));
+		}
+
+		for (; j + VEC_WIDTH <= cols; j += VEC_WIDTH) {
+			memcpy(&c0, &cr[j], sizeof(c0));
+			for (k = 0; k < inner; ++k) {
+				ak = a[i * lda + k] - (VecD){ 0 };
+				memcpy(&b0, &b[k * ldb + j], sizeof(b0));
+				c0 += ak * b0;
+			}
+			memcpy(&cr[j], &c0, sizeof(c0));
+		}
+
+		for (k = 0; k < inner && j < cols; ++k) {
+			aik = a[i * lda + k];
+			br = &b[k * ldb];
+			for (m = j; m < cols; ++m)
+				cr[m] += aik * br[m];
+		}
+	}
+}
@@ -0,0 +1,23 @@
+/* See LICENSE file for copyright and license details. */
+
+double vec_sum(const double *x, int n);
+double vec_ksum(const double *x, int n);
+double vec_prod(const double *x, int n);
+double vec_min(const double *x, int n);
+double vec_max(const double *x, int n);
+double vec_dot(const double *x, const double *y, int n);
+void vec_scale(double *x, int n, double k);
+double vec_horner(const double *c, int n, double x);
+void vec_poly(double *y, const double *x, int m, const double *c, int n);
+void vec_offset(double *x, int n, double k);
+void vec_exp(double *y, const double *x, int n);
+void vec_log(double *y, const double *x, int n);
+void vec_pow(double *y, const double *x, const double *e, int n);
+void vec_sin(double *y, const double *x, int n);
+void vec_cos(double *y, const double *x, int n);
+void vec_tan(double *y, const double *x, int n);
+void vec_cot(double *y, const double *x, int n);
+void vec_sec(double *y, const double *x, int n);
+void vec_csc(double *y, const double *x, int n);
+void vec_mul_block(double *c, int ldc, const double *a, int lda,
+                   const double *b, int ldb, int rows, int inner, int cols);